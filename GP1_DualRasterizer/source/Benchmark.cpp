@@ -0,0 +1,241 @@
+#include "pch.h"
+#include "Benchmark.h"
+#include <fstream>
+#include <numeric>
+
+namespace dae
+{
+	//Nearest rank on sorted frame times
+	static float Percentile(const std::vector<float>& sortedTimes, float percentile)
+	{
+		const size_t rank{ size_t(std::ceil(percentile / 100.f * sortedTimes.size())) };
+		return sortedTimes[std::clamp(rank, size_t(1), sortedTimes.size()) - 1];
+	}
+
+	void Benchmark::AddFrameTime(float milliseconds)
+	{
+		m_FrameTimesMs.push_back(milliseconds);
+	}
+
+	void Benchmark::AddFrameStats(const RasterizerStats& stats)
+	{
+		m_TotalStats += stats;
+		++m_NumStatsFrames;
+	}
+
+	Benchmark::Stats Benchmark::CalculateStats() const
+	{
+		Stats stats{};
+		if (m_FrameTimesMs.empty())
+			return stats;
+
+		std::vector<float> sortedTimes{ m_FrameTimesMs };
+		std::sort(sortedTimes.begin(), sortedTimes.end());
+
+		stats.numFrames = uint32_t(sortedTimes.size());
+		stats.meanMs = float(std::accumulate(sortedTimes.begin(), sortedTimes.end(), 0.0) / sortedTimes.size());
+		stats.p50Ms = Percentile(sortedTimes, 50.f);
+		stats.p95Ms = Percentile(sortedTimes, 95.f);
+		stats.p99Ms = Percentile(sortedTimes, 99.f);
+
+		//Slowest 1%, at least one frame
+		const size_t numLowFrames{ std::max(sortedTimes.size() / 100, size_t(1)) };
+		const double lowMs{ std::accumulate(sortedTimes.end() - numLowFrames, sortedTimes.end(), 0.0) / numLowFrames };
+		stats.low1PercentFps = lowMs > 0.0 ? float(1000.0 / lowMs) : 0.f;
+
+		return stats;
+	}
+
+	bool Benchmark::WriteJson(const std::string& path, const Config& config) const
+	{
+		std::ofstream file{ path };
+		if (!file)
+			return false;
+
+		const Stats stats{ CalculateStats() };
+		file << "{\n";
+		file << "  \"width\": " << config.width << ",\n";
+		file << "  \"height\": " << config.height << ",\n";
+		file << "  \"warmup_frames\": " << config.warmupFrames << ",\n";
+		file << "  \"threads\": " << config.numThreads << ",\n";
+		file << "  \"pipeline_depth\": " << config.pipelineDepth << ",\n";
+		file << "  \"kernels\": \"" << config.kernels << "\",\n";
+		file << "  \"mesh\": \"" << EscapeJson(config.meshPath) << "\",\n";
+		file << "  \"frames\": " << stats.numFrames << ",\n";
+		file << "  \"mean_ms\": " << stats.meanMs << ",\n";
+		file << "  \"p50_ms\": " << stats.p50Ms << ",\n";
+		file << "  \"p95_ms\": " << stats.p95Ms << ",\n";
+		file << "  \"p99_ms\": " << stats.p99Ms << ",\n";
+		file << "  \"low_1_percent_fps\": " << stats.low1PercentFps << ",\n";
+
+		if (m_NumStatsFrames > 0)
+		{
+			const double frames{ double(m_NumStatsFrames) };
+			const RasterizerStats& total{ m_TotalStats };
+			file << "  \"rasterizer_stats_per_frame\": {\n";
+			file << "    \"triangles_submitted\": " << total.trianglesSubmitted / frames << ",\n";
+			file << "    \"triangles_frustum_culled\": " << total.trianglesFrustumCulled / frames << ",\n";
+			file << "    \"triangles_clipped\": " << total.trianglesClipped / frames << ",\n";
+			file << "    \"triangles_backface_culled\": " << total.trianglesBackfaceCulled / frames << ",\n";
+			file << "    \"triangles_degenerate\": " << total.trianglesDegenerate / frames << ",\n";
+			file << "    \"triangles_binned\": " << total.trianglesBinned / frames << ",\n";
+			file << "    \"triangles_hiz_culled\": " << total.trianglesHiZCulled / frames << ",\n";
+			file << "    \"pixels_covered\": " << total.pixelsCovered / frames << ",\n";
+			file << "    \"depth_tests_passed\": " << total.depthTestsPassed / frames << ",\n";
+			file << "    \"depth_tests_failed\": " << total.depthTestsFailed / frames << ",\n";
+			file << "    \"pixels_written\": " << total.pixelsWritten / frames << ",\n";
+			file << "    \"pixel_shading_invocations\": " << total.pixelShadingInvocations / frames << ",\n";
+			file << "    \"texture_samples\": " << total.textureSamples / frames << ",\n";
+			file << "    \"overdraw\": " << total.GetOverdraw() << "\n";
+			file << "  },\n";
+		}
+		file << "  \"frame_times_ms\": [";
+		for (size_t i{}; i < m_FrameTimesMs.size(); ++i)
+		{
+			file << (i == 0 ? "" : ", ") << m_FrameTimesMs[i];
+		}
+		file << "]\n";
+		file << "}\n";
+
+		return bool(file);
+	}
+
+	bool Benchmark::ReadStats(const std::string& path, Stats& stats, Config& config)
+	{
+		std::string text{};
+		if (!ReadJson(path, text))
+			return false;
+
+		float numFrames{};
+		const bool isValid{ FindJsonNumber(text, "frames", numFrames) &&
+			FindJsonNumber(text, "mean_ms", stats.meanMs) &&
+			FindJsonNumber(text, "p50_ms", stats.p50Ms) &&
+			FindJsonNumber(text, "p95_ms", stats.p95Ms) &&
+			FindJsonNumber(text, "p99_ms", stats.p99Ms) &&
+			FindJsonNumber(text, "low_1_percent_fps", stats.low1PercentFps) };
+		stats.numFrames = uint32_t(numFrames);
+
+		//Older files miss some of these, IsSameSetup then reports them as different
+		float width{}, height{}, warmupFrames{}, numThreads{}, pipelineDepth{};
+		FindJsonNumber(text, "width", width);
+		FindJsonNumber(text, "height", height);
+		FindJsonNumber(text, "warmup_frames", warmupFrames);
+		FindJsonNumber(text, "threads", numThreads);
+		FindJsonNumber(text, "pipeline_depth", pipelineDepth);
+		FindJsonString(text, "kernels", config.kernels);
+		FindJsonString(text, "mesh", config.meshPath);
+		config.width = int(width);
+		config.height = int(height);
+		config.warmupFrames = uint32_t(warmupFrames);
+		config.numThreads = uint32_t(numThreads);
+		config.pipelineDepth = uint32_t(pipelineDepth);
+
+		return isValid;
+	}
+
+	bool Benchmark::IsSameSetup(const Config& config, const Config& baseline)
+	{
+		bool isSame{ true };
+		const auto check = [&](const char* name, const auto& value, const auto& baselineValue)
+			{
+				if (value == baselineValue)
+					return;
+
+				std::cout << "Setup differs from the baseline in " << name << ": " << value << " (baseline " << baselineValue << ")\n";
+				isSame = false;
+			};
+
+		check("width", config.width, baseline.width);
+		check("height", config.height, baseline.height);
+		check("warmup_frames", config.warmupFrames, baseline.warmupFrames);
+		check("threads", config.numThreads, baseline.numThreads);
+		check("pipeline_depth", config.pipelineDepth, baseline.pipelineDepth);
+		check("kernels", config.kernels, baseline.kernels);
+		check("mesh", config.meshPath, baseline.meshPath);
+
+		return isSame;
+	}
+
+	bool Benchmark::IsRegression(const Stats& stats, const Stats& baseline, float tolerance)
+	{
+		//No short circuit, every regression gets printed
+		bool isRegression{ false };
+		isRegression |= IsWorse("mean_ms", stats.meanMs, baseline.meanMs, tolerance, false);
+		isRegression |= IsWorse("p50_ms", stats.p50Ms, baseline.p50Ms, tolerance, false);
+		isRegression |= IsWorse("p95_ms", stats.p95Ms, baseline.p95Ms, tolerance, false);
+		isRegression |= IsWorse("p99_ms", stats.p99Ms, baseline.p99Ms, tolerance, false);
+		isRegression |= IsWorse("low_1_percent_fps", stats.low1PercentFps, baseline.low1PercentFps, tolerance, true);
+
+		return isRegression;
+	}
+
+	bool Benchmark::ReadJson(const std::string& path, std::string& text)
+	{
+		std::ifstream file{ path };
+		if (!file)
+			return false;
+
+		std::stringstream stream{};
+		stream << file.rdbuf();
+		text = stream.str();
+		return true;
+	}
+
+	//Enough for the files the benchmarks write, not a json parser
+	bool Benchmark::FindJsonNumber(const std::string& text, const std::string& key, float& value, size_t start)
+	{
+		const size_t keyPosition{ text.find('"' + key + '"', start) };
+		if (keyPosition == std::string::npos)
+			return false;
+
+		const size_t colon{ text.find(':', keyPosition) };
+		if (colon == std::string::npos)
+			return false;
+
+		std::istringstream valueStream{ text.substr(colon + 1, 32) };
+		return bool(valueStream >> value);
+	}
+
+	bool Benchmark::FindJsonString(const std::string& text, const std::string& key, std::string& value)
+	{
+		const size_t keyPosition{ text.find('"' + key + '"') };
+		if (keyPosition == std::string::npos)
+			return false;
+
+		const size_t open{ text.find('"', text.find(':', keyPosition)) };
+		if (open == std::string::npos)
+			return false;
+
+		value.clear();
+		for (size_t i{ open + 1 }; i < text.size(); ++i)
+		{
+			if (text[i] == '"')
+				return true;
+			if (text[i] == '\\')
+				++i;
+			if (i < text.size())
+				value += text[i];
+		}
+		return false;
+	}
+
+	std::string Benchmark::EscapeJson(const std::string& text)
+	{
+		std::string escaped{};
+		for (const char character : text)
+		{
+			if (character == '"' || character == '\\')
+				escaped += '\\';
+			escaped += character;
+		}
+		return escaped;
+	}
+
+	bool Benchmark::IsWorse(const std::string& name, float value, float baselineValue, float tolerance, bool isHigherBetter)
+	{
+		const bool isWorse{ isHigherBetter ? value < baselineValue * (1.f - tolerance) : value > baselineValue * (1.f + tolerance) };
+		if (isWorse)
+			std::cout << "Regression in " << name << ": " << value << " (baseline " << baselineValue << ")\n";
+		return isWorse;
+	}
+}
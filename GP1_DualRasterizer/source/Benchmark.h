@@ -0,0 +1,71 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "RasterizerStats.h"
+
+namespace dae
+{
+	//Collects frame times of a benchmark run and turns them into the numbers we compare runs on
+	class Benchmark final
+	{
+	public:
+		struct Stats
+		{
+			uint32_t numFrames{};
+			float meanMs{};
+			float p50Ms{};
+			float p95Ms{};
+			float p99Ms{};
+			//Average fps over the slowest 1% of the frames
+			float low1PercentFps{};
+		};
+
+		//Describes the run in the json, so results of different setups don't get compared by accident
+		struct Config
+		{
+			int width{};
+			int height{};
+			uint32_t warmupFrames{};
+			uint32_t numThreads{};
+			//Software frames in flight, see Renderer::SetFramePipelineDepth
+			uint32_t pipelineDepth{};
+			//Rasterizer kernels, avx2 or scalar
+			std::string kernels{};
+			std::string meshPath{};
+		};
+
+		Benchmark() = default;
+
+		void AddFrameTime(float milliseconds);
+		//Written to the json as the average per frame
+		void AddFrameStats(const RasterizerStats& stats);
+		Stats CalculateStats() const;
+
+		bool WriteJson(const std::string& path, const Config& config) const;
+		//Reads the stats and the setup back from a json written by WriteJson
+		static bool ReadStats(const std::string& path, Stats& stats, Config& config);
+		//Prints every setting that differs, runs of different setups can't be compared
+		static bool IsSameSetup(const Config& config, const Config& baseline);
+		//Prints every number that got worse than the baseline by more than tolerance (0.05 = 5%)
+		static bool IsRegression(const Stats& stats, const Stats& baseline, float tolerance);
+
+		//Helpers for the json files of the benchmarks, also used by KernelBenchmarks
+		static bool ReadJson(const std::string& path, std::string& text);
+		//Value of "key": <number>, the first one from start on
+		static bool FindJsonNumber(const std::string& text, const std::string& key, float& value, size_t start = 0);
+		//Value of "key": "<string>", unescaped again
+		static bool FindJsonString(const std::string& text, const std::string& key, std::string& value);
+		//Only quotes and backslashes, the strings are file paths and kernel names
+		static std::string EscapeJson(const std::string& text);
+		//Prints the number when it got worse than the baseline by more than tolerance
+		static bool IsWorse(const std::string& name, float value, float baselineValue, float tolerance, bool isHigherBetter);
+
+	private:
+		std::vector<float> m_FrameTimesMs{};
+		RasterizerStats m_TotalStats{};
+		uint32_t m_NumStatsFrames{};
+	};
+}
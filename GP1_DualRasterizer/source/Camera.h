@@ -136,6 +136,21 @@ struct Camera final
 		}
 
 
+		CalculateOrientation();
+	}
+
+	//Pitch and yaw in radians, like the mouse input
+	void SetPose(const Vector3& _origin, float pitch, float yaw)
+	{
+		origin = _origin;
+		totalPitch = pitch;
+		totalYaw = yaw;
+
+		CalculateOrientation();
+	}
+
+	void CalculateOrientation()
+	{
 		const Matrix finalRotation{ Matrix::CreateRotationX(totalPitch) * Matrix::CreateRotationY(totalYaw) };
 		forward = finalRotation.TransformVector(Vector3::UnitZ);
 		forward.Normalize();
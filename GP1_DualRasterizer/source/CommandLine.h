@@ -0,0 +1,24 @@
+#pragma once
+
+//Standard includes
+#include <charconv>
+#include <iostream>
+#include <string>
+
+//Shared by the command lines of the DirectX and KernelBenchmarks executables
+namespace dae
+{
+	//The whole value has to be the number, so "abc", "-1" and "12x" are rejected instead of throwing or wrapping
+	template<typename Number>
+	bool ParseNumber(const std::string& option, const std::string& value, Number& number)
+	{
+		const char* pEnd{ value.data() + value.size() };
+		const auto [pLast, error]{ std::from_chars(value.data(), pEnd, number) };
+		if (error != std::errc{} || pLast != pEnd)
+		{
+			std::cout << "Invalid value " << value << " for " << option << '\n';
+			return false;
+		}
+		return true;
+	}
+}
@@ -35,4 +35,122 @@ struct Mesh
 
 	std::vector<Vertex_Out> vertices_out{};
 	Matrix worldMatrix{};
+};
+
+//Software rasterizer
+//Sub-pixel precision of the fixed point positions (16.8)
+constexpr int g_SubPixelBits{ 8 };
+constexpr int64_t g_SubPixelScale{ 1 << g_SubPixelBits };
+//Depth after clipping is kept just above the near plane, the depth interpolation divides by it
+constexpr float g_MinClippedDepth{ 1e-6f };
+
+struct EdgeFunction
+{
+	//e(x, y) = a * x + b * y + c
+	float a{};
+	float b{};
+	float c{};
+
+	float Evaluate(float x, float y) const
+	{
+		return a * x + b * y + c;
+	}
+};
+
+struct EdgeFunctionFixed
+{
+	//e(x, y) = a * x + b * y + c on 16.8 fixed point coordinates
+	//Biased by the top-left rule, so e >= 0 means covered and shared edges are only drawn once
+	int64_t a{};
+	int64_t b{};
+	int64_t c{};
+
+	int64_t Evaluate(int64_t x, int64_t y) const
+	{
+		return a * x + b * y + c;
+	}
+};
+
+struct TriangleRast
+{
+	//Positions are in screen space (x, y), NDC depth (z) and view depth (w)
+	Vertex_Out A{};
+	Vertex_Out B{};
+	Vertex_Out C{};
+
+	//Scaled by 1 / area, so they evaluate straight to the barycentric weight of the opposite vertex
+	EdgeFunction edgeBC{}; //weight of A
+	EdgeFunction edgeCA{}; //weight of B
+	EdgeFunction edgeAB{}; //weight of C
+
+	//Same edges on the snapped integer positions, these decide coverage
+	EdgeFunctionFixed fixedBC{};
+	EdgeFunctionFixed fixedCA{};
+	EdgeFunctionFixed fixedAB{};
+
+	//1 / z and 1 / w of A, B and C
+	Vector3 invZ{};
+	Vector3 invW{};
+	//Screen space x/y gradients of the weight edges times 1 / w, for the uv derivatives
+	Vector3 invWdx{};
+	Vector3 invWdy{};
+	//Closest depth of the triangle
+	float minZ{};
+
+	//Screen bounding box, max is exclusive
+	int minX{};
+	int minY{};
+	int maxX{};
+	int maxY{};
+};
+
+struct TileRast
+{
+	//Screen rect, max is exclusive
+	int minX{};
+	int minY{};
+	int maxX{};
+	int maxY{};
+
+	//Indices into the binned triangles, in submission order
+	std::vector<uint32_t> triangleIndices{};
+};
+
+//Vertex stage input as structure of arrays, one entry per vertex, so it can be transformed 8 vertices at a time.
+//Filled once when the mesh is loaded
+struct VertexStreams
+{
+	std::vector<float> positionX{};
+	std::vector<float> positionY{};
+	std::vector<float> positionZ{};
+	std::vector<float> normalX{};
+	std::vector<float> normalY{};
+	std::vector<float> normalZ{};
+	std::vector<float> tangentX{};
+	std::vector<float> tangentY{};
+	std::vector<float> tangentZ{};
+};
+
+//Output of the vertex stage for one mesh, one entry per vertex
+struct TransformedVertexStreams
+{
+	std::vector<float> clipX{};
+	std::vector<float> clipY{};
+	std::vector<float> clipZ{};
+	std::vector<float> clipW{};
+	//Screen space x/y and NDC depth, only meaningful when the vertex doesn't need clipping
+	std::vector<float> screenX{};
+	std::vector<float> screenY{};
+	std::vector<float> screenZ{};
+	std::vector<float> worldNormalX{};
+	std::vector<float> worldNormalY{};
+	std::vector<float> worldNormalZ{};
+	std::vector<float> worldTangentX{};
+	std::vector<float> worldTangentY{};
+	std::vector<float> worldTangentZ{};
+	std::vector<float> viewDirectionX{};
+	std::vector<float> viewDirectionY{};
+	std::vector<float> viewDirectionZ{};
+	//Frustum planes the vertex is outside of, guard band planes shifted up by 8
+	std::vector<uint16_t> clipCodes{};
 };
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "pch.h"
+#include "FrameWriter.h"
+#include "Profiler.h"
+
+namespace dae
+{
+	FrameWriter::FrameWriter(int width, int height, uint32_t numThreads, uint32_t maxQueuedFrames) :
+		m_Width{ width },
+		m_Height{ height },
+		m_MaxQueuedFrames{ std::max(1u, maxQueuedFrames) }
+	{
+		numThreads = std::max(1u, numThreads);
+		m_Threads.reserve(numThreads);
+		for (uint32_t i{}; i < numThreads; ++i)
+		{
+			m_Threads.emplace_back(&FrameWriter::WriterLoop, this);
+		}
+	}
+
+	FrameWriter::~FrameWriter()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_WakeCondition.notify_all();
+
+		for (auto& thread : m_Threads)
+		{
+			thread.join();
+		}
+	}
+
+	void FrameWriter::Write(const uint32_t* pPixels, const std::string& path)
+	{
+		Frame frame{};
+		{
+			//Only wait when the disk has fallen a whole queue behind
+			std::unique_lock lock{ m_Mutex };
+			m_DoneCondition.wait(lock, [this]() { return m_Queue.size() + m_NumBusy < m_MaxQueuedFrames; });
+			if (!m_FreeBuffers.empty())
+			{
+				frame.pixels = std::move(m_FreeBuffers.back());
+				m_FreeBuffers.pop_back();
+			}
+		}
+
+		frame.pixels.assign(pPixels, pPixels + size_t(m_Width) * m_Height);
+		frame.path = path;
+
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_Queue.push_back(std::move(frame));
+		}
+		m_WakeCondition.notify_one();
+	}
+
+	void FrameWriter::Flush()
+	{
+		std::unique_lock lock{ m_Mutex };
+		m_DoneCondition.wait(lock, [this]() { return m_Queue.empty() && m_NumBusy == 0; });
+	}
+
+	uint32_t FrameWriter::GetNumFailed() const
+	{
+		std::lock_guard lock{ m_Mutex };
+		return m_NumFailed;
+	}
+
+	void FrameWriter::WriterLoop()
+	{
+		PROFILE_THREAD_NAME("Frame writer");
+
+		while (true)
+		{
+			Frame frame{};
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_WakeCondition.wait(lock, [this]() { return m_IsStopping || !m_Queue.empty(); });
+				if (m_Queue.empty())
+					return;
+
+				frame = std::move(m_Queue.front());
+				m_Queue.pop_front();
+				++m_NumBusy;
+			}
+
+			const bool isSaved{ SaveFrame(frame) };
+
+			{
+				std::lock_guard lock{ m_Mutex };
+				if (!isSaved)
+					++m_NumFailed;
+				m_FreeBuffers.push_back(std::move(frame.pixels));
+				--m_NumBusy;
+			}
+			m_DoneCondition.notify_all();
+		}
+	}
+
+	bool FrameWriter::SaveFrame(Frame& frame) const
+	{
+		PROFILE_ZONE("Write frame");
+
+		SDL_Surface* pSurface{ SDL_CreateRGBSurfaceWithFormatFrom(frame.pixels.data(), m_Width, m_Height, 32, m_Width * 4, SDL_PIXELFORMAT_ARGB8888) };
+		if (!pSurface)
+			return false;
+
+		const bool isBitmap{ frame.path.size() >= 4 && frame.path.compare(frame.path.size() - 4, 4, ".bmp") == 0 };
+		const int result{ isBitmap ? SDL_SaveBMP(pSurface, frame.path.c_str()) : IMG_SavePNG(pSurface, frame.path.c_str()) };
+		SDL_FreeSurface(pSurface);
+
+		if (result != 0)
+			std::cout << "Could not write " << frame.path << ": " << SDL_GetError() << '\n';
+
+		return result == 0;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	//Writes frames to image files on background threads, so encoding and disk writes never wait on the rasterizer.
+	//The file extension picks the format: .bmp is written with SDL, anything else as png with SDL_image
+	class FrameWriter final
+	{
+	public:
+		//maxQueuedFrames bounds the memory, Write only blocks when that many frames are still waiting for the disk
+		FrameWriter(int width, int height, uint32_t numThreads = 2, uint32_t maxQueuedFrames = 16);
+		//Writes everything that is still queued first
+		~FrameWriter();
+
+		FrameWriter(const FrameWriter&) = delete;
+		FrameWriter(FrameWriter&&) noexcept = delete;
+		FrameWriter& operator=(const FrameWriter&) = delete;
+		FrameWriter& operator=(FrameWriter&&) noexcept = delete;
+
+		//Copies width * height 0xAARRGGBB pixels and queues them to be written to path
+		void Write(const uint32_t* pPixels, const std::string& path);
+		//Returns once every queued frame is on disk
+		void Flush();
+
+		uint32_t GetNumFailed() const;
+
+	private:
+		struct Frame
+		{
+			std::vector<uint32_t> pixels{};
+			std::string path{};
+		};
+
+		int m_Width{};
+		int m_Height{};
+		uint32_t m_MaxQueuedFrames{};
+
+		mutable std::mutex m_Mutex{};
+		std::condition_variable m_WakeCondition{};
+		std::condition_variable m_DoneCondition{};
+
+		std::deque<Frame> m_Queue{};
+		//Pixel buffers of written frames, reused so a long sequence doesn't allocate per frame
+		std::vector<std::vector<uint32_t>> m_FreeBuffers{};
+		uint32_t m_NumBusy{};
+		uint32_t m_NumFailed{};
+		bool m_IsStopping{ false };
+
+		std::vector<std::thread> m_Threads{};
+
+		void WriterLoop();
+		bool SaveFrame(Frame& frame) const;
+	};
+}
@@ -0,0 +1,480 @@
+#include "pch.h"
+#include "KernelBenchmarks.h"
+#include "Benchmark.h"
+#include "Renderer.h"
+#include "DataTypes.h"
+#include "Texture.h"
+#include "MaterialTexture.h"
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <tuple>
+
+namespace dae
+{
+	//Every pass writes here, so the compiler can't drop the work of a kernel whose results are never read
+	static volatile float g_Sink{};
+
+	//Items per timed batch of passes, so reading the clock doesn't show up in the small sizes
+	constexpr size_t g_MinItemsPerBatch{ 1 << 16 };
+
+	static Vector3 RandomUnitVector(std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> distribution{ -1.f, 1.f };
+		Vector3 v{};
+		do
+		{
+			v = { distribution(random), distribution(random), distribution(random) };
+		} while (v.SqrMagnitude() < 0.01f || v.SqrMagnitude() > 1.f);
+		return v.Normalized();
+	}
+
+	KernelBenchmarks::KernelBenchmarks(float minSecondsPerKernel) :
+		m_MinSeconds{ minSecondsPerKernel }
+	{
+	}
+
+	template<typename Pass>
+	void KernelBenchmarks::Measure(const std::string& name, size_t numItems, Pass pass)
+	{
+		//One untimed pass, so page faults of freshly allocated inputs don't end up in the numbers
+		g_Sink = pass();
+
+		const size_t passesPerBatch{ std::max(size_t(1), g_MinItemsPerBatch / numItems) };
+		uint64_t numPasses{};
+		const auto start{ std::chrono::steady_clock::now() };
+		auto end{ start };
+		do
+		{
+			for (size_t i{}; i < passesPerBatch; ++i)
+			{
+				g_Sink = pass();
+			}
+			numPasses += passesPerBatch;
+			end = std::chrono::steady_clock::now();
+		} while (std::chrono::duration<float>(end - start).count() < m_MinSeconds);
+
+		const double nsPerOp{ std::chrono::duration<double, std::nano>(end - start).count() / (double(numPasses) * numItems) };
+		m_Results.push_back({ name, nsPerOp, 1e9 / nsPerOp });
+
+		std::ostringstream line{};
+		line << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(12) << nsPerOp << " ns/op" << std::setprecision(2) << std::setw(12) << 1e3 / nsPerOp << " M items/s\n";
+		std::cout << line.str();
+	}
+
+	void KernelBenchmarks::RunMath()
+	{
+		std::mt19937 random{ 1 };
+		std::uniform_real_distribution<float> angle{ -PI, PI };
+		std::uniform_real_distribution<float> coordinate{ -100.f, 100.f };
+		std::uniform_real_distribution<float> scale{ 0.5f, 2.f };
+
+		for (const size_t size : { size_t(16), size_t(1024), size_t(65536) })
+		{
+			//Rotation, scale and translation like the world matrices, so every one of them is invertible
+			std::vector<Matrix> matricesA(size);
+			std::vector<Matrix> matricesB(size);
+			std::vector<Matrix> matricesOut(size);
+			std::vector<Vector3> points3(size);
+			std::vector<Vector4> points4(size);
+			std::vector<Vector3> points3Out(size);
+			std::vector<Vector4> points4Out(size);
+			for (size_t i{}; i < size; ++i)
+			{
+				matricesA[i] = Matrix::CreateScale(scale(random), scale(random), scale(random)) *
+					Matrix::CreateRotation(angle(random), angle(random), angle(random)) *
+					Matrix::CreateTranslation(coordinate(random), coordinate(random), coordinate(random));
+				matricesB[i] = Matrix::CreateRotation(angle(random), angle(random), angle(random)) *
+					Matrix::CreateTranslation(coordinate(random), coordinate(random), coordinate(random));
+				points3[i] = { coordinate(random), coordinate(random), coordinate(random) };
+				points4[i] = { points3[i], 1.f };
+			}
+
+			const std::string suffix{ '/' + std::to_string(size) };
+			Measure("matrix_multiply" + suffix, size, [&]()
+				{
+					for (size_t i{}; i < size; ++i)
+					{
+						matricesOut[i] = matricesA[i] * matricesB[i];
+					}
+					return matricesOut[size - 1][3].x;
+				});
+			Measure("matrix_transform_point3" + suffix, size, [&]()
+				{
+					const Matrix& matrix{ matricesA[0] };
+					for (size_t i{}; i < size; ++i)
+					{
+						points3Out[i] = matrix.TransformPoint(points3[i]);
+					}
+					return points3Out[size - 1].x;
+				});
+			Measure("matrix_transform_point4" + suffix, size, [&]()
+				{
+					const Matrix& matrix{ matricesA[0] };
+					for (size_t i{}; i < size; ++i)
+					{
+						points4Out[i] = matrix.TransformPoint(points4[i]);
+					}
+					return points4Out[size - 1].x;
+				});
+			Measure("matrix_transform_points4_batch" + suffix, size, [&]()
+				{
+					matricesA[0].TransformPoints(points3, points4Out);
+					return points4Out[size - 1].x;
+				});
+			Measure("matrix_transform_normals_batch" + suffix, size, [&]()
+				{
+					matricesA[0].TransformNormals(points3, points3Out);
+					return points3Out[size - 1].x;
+				});
+			Measure("matrix_inverse" + suffix, size, [&]()
+				{
+					for (size_t i{}; i < size; ++i)
+					{
+						matricesOut[i] = Matrix::Inverse(matricesA[i]);
+					}
+					return matricesOut[size - 1][3].x;
+				});
+			Measure("vector3_normalize" + suffix, size, [&]()
+				{
+					float sum{};
+					for (size_t i{}; i < size; ++i)
+					{
+						Vector3 v{ points3[i] };
+						sum += v.Normalize();
+						points3Out[i] = v;
+					}
+					return sum;
+				});
+		}
+	}
+
+	void KernelBenchmarks::RunRasterizer(Renderer& renderer)
+	{
+		std::mt19937 random{ 2 };
+		std::uniform_real_distribution<float> coordinate{ 0.f, float(std::min(renderer.m_Width, renderer.m_Height)) };
+		std::uniform_real_distribution<float> depth{ 0.9f, 0.999f };
+
+		//Setup of random screen space triangles, half of them back facing so both windings are in there
+		{
+			constexpr size_t numTriangles{ 1024 };
+			std::vector<TriangleRast> inputs(numTriangles);
+			for (TriangleRast& triangle : inputs)
+			{
+				for (Vertex_Out* pVertex : { &triangle.A, &triangle.B, &triangle.C })
+				{
+					pVertex->position = { coordinate(random), coordinate(random), depth(random), 1.f + depth(random) };
+				}
+			}
+
+			std::vector<TriangleRast> triangles(numTriangles);
+			RasterizerStats stats{};
+			Measure("triangle_setup", numTriangles, [&]()
+				{
+					uint32_t numAccepted{};
+					for (size_t i{}; i < numTriangles; ++i)
+					{
+						triangles[i] = inputs[i];
+						numAccepted += renderer.SetupTriangle(triangles[i], Renderer::CullMode::None, stats);
+					}
+					return float(numAccepted);
+				});
+		}
+
+		//The tile kernels write the visibility buffer instead of shading, so only coverage, depth test and the
+		//barycentric stepping get timed (PixelShading has its own numbers). Nothing gets rejected by the Hi-Z,
+		//and the depth test passes on equal depth, so every pass writes the same pixels as the first one
+		const bool wasUsingVisibilityBuffer{ renderer.m_UsingVisibilityBuffer };
+		const bool wasUsingAVX2Kernels{ renderer.AreAVX2KernelsEnabled() };
+		renderer.m_UsingVisibilityBuffer = true;
+		std::fill_n(renderer.m_pDepthBufferPixels, renderer.m_Width * renderer.m_Height, FLT_MAX);
+		std::fill_n(renderer.m_pCoarseDepthPixels, renderer.m_NumBlocksX * renderer.m_NumBlocksY, FLT_MAX);
+		const std::vector<TileRast>& tiles{ renderer.m_FramesRast[0].tiles };
+
+		//Coarse depth block, tile and a triangle over several tiles
+		for (const int size : { 8, 64, 256 })
+		{
+			if (size > renderer.m_Width || size > renderer.m_Height)
+				continue;
+
+			//A triangle covering about a third of the block, at sub-pixel positions
+			TriangleRast triangle{};
+			triangle.A.position = { 0.1f * size + 0.3f, 0.05f * size + 0.7f, 0.5f, 2.f };
+			triangle.B.position = { 0.95f * size - 0.2f, 0.3f * size + 0.4f, 0.6f, 3.f };
+			triangle.C.position = { 0.4f * size + 0.1f, 0.9f * size - 0.6f, 0.7f, 4.f };
+			RasterizerStats stats{};
+			renderer.SetupTriangle(triangle, Renderer::CullMode::None, stats);
+
+			//Every tile the bounding box touches, clamped like RasterizeTile does
+			const auto rasterize = [&]()
+				{
+					uint64_t dirtyBlocks{};
+					for (const TileRast& tile : tiles)
+					{
+						const int minX{ std::max(triangle.minX, tile.minX) };
+						const int minY{ std::max(triangle.minY, tile.minY) };
+						const int maxX{ std::min(triangle.maxX, tile.maxX) };
+						const int maxY{ std::min(triangle.maxY, tile.maxY) };
+						if (minX >= maxX || minY >= maxY)
+							continue;
+
+						dirtyBlocks |= renderer.m_UseAVX2Kernels ?
+							renderer.RasterizeTriangleAVX2(triangle, 0, tile, minX, minY, maxX, maxY, stats) :
+							renderer.RasterizeTriangle(triangle, 0, tile, minX, minY, maxX, maxY, stats);
+					}
+					return float(dirtyBlocks);
+				};
+
+			const size_t numPixels{ size_t(size) * size };
+			const std::string suffix{ '/' + std::to_string(size) };
+			renderer.SetAVX2KernelsEnabled(false);
+			Measure("rasterize_triangle/scalar" + suffix, numPixels, rasterize);
+
+			renderer.SetAVX2KernelsEnabled(true);
+			if (renderer.AreAVX2KernelsEnabled())
+				Measure("rasterize_triangle/avx2" + suffix, numPixels, rasterize);
+		}
+
+		renderer.m_UsingVisibilityBuffer = wasUsingVisibilityBuffer;
+		renderer.SetAVX2KernelsEnabled(wasUsingAVX2Kernels);
+	}
+
+	void KernelBenchmarks::RunTextureSampling()
+	{
+		std::mt19937 random{ 3 };
+		std::uniform_real_distribution<float> uvDistribution{ 0.f, 1.f };
+
+		//Noise, so no two neighbouring texels are the same. The texture frees the surface
+		const auto createNoiseTexture = [&random](int size, Texture::Layout layout)
+			{
+				SDL_Surface* pSurface{ SDL_CreateRGBSurfaceWithFormat(0, size, size, 32, SDL_PIXELFORMAT_ABGR8888) };
+				uint32_t* pPixels{ static_cast<uint32_t*>(pSurface->pixels) };
+				for (size_t i{}; i < size_t(size) * size; ++i)
+				{
+					pPixels[i] = uint32_t(random());
+				}
+				return new Texture{ pSurface, layout };
+			};
+
+		//side * side pixels in three orders: linear = scanlines, tiled = 8x8 blocks like a screen tile,
+		//random = uniform over the texture like many small triangles all over it. Pixel (x, y) is at origin + x * dUVdx + y * dUVdy
+		constexpr int blockSize{ 8 };
+		const auto createUVs = [&](int side, const Vector2& origin, const Vector2& dUVdx, const Vector2& dUVdy)
+			{
+				const size_t numPixels{ size_t(side) * side };
+				std::array<std::vector<Vector2>, 3> uvs{};
+				for (std::vector<Vector2>& order : uvs)
+				{
+					order.reserve(numPixels);
+				}
+				const auto pixelUV = [&](int x, int y) { return origin + dUVdx * (x + 0.5f) + dUVdy * (y + 0.5f); };
+
+				for (int y{}; y < side; ++y)
+				{
+					for (int x{}; x < side; ++x)
+					{
+						uvs[0].push_back(pixelUV(x, y));
+						uvs[2].push_back({ uvDistribution(random), uvDistribution(random) });
+					}
+				}
+				for (int blockY{}; blockY < side; blockY += blockSize)
+				{
+					for (int blockX{}; blockX < side; blockX += blockSize)
+					{
+						for (int y{ blockY }; y < blockY + blockSize; ++y)
+						{
+							for (int x{ blockX }; x < blockX + blockSize; ++x)
+							{
+								uvs[1].push_back(pixelUV(x, y));
+							}
+						}
+					}
+				}
+				return uvs;
+			};
+		const char* const orderNames[]{ "linear", "tiled", "random" };
+
+		//Texture::Sample, the nearest texel of the full level. Every texel once per pass, at its center, on both texel layouts
+		for (const int size : { 64, 256, 1024, 2048 })
+		{
+			const size_t numTexels{ size_t(size) * size };
+			const auto uvs{ createUVs(size, {}, { 1.f / size, 0.f }, { 0.f, 1.f / size }) };
+
+			for (const Texture::Layout layout : { Texture::Layout::Linear, Texture::Layout::Tiled })
+			{
+				const Texture* pTexture{ createNoiseTexture(size, layout) };
+
+				const std::string prefix{ layout == Texture::Layout::Linear ? "texture_sample/linear_layout/" : "texture_sample/tiled_layout/" };
+				const std::string suffix{ '/' + std::to_string(size) };
+				for (size_t order{}; order < uvs.size(); ++order)
+				{
+					Measure(prefix + orderNames[order] + suffix, numTexels, [&]()
+						{
+							float sum{};
+							for (const Vector2& uv : uvs[order])
+							{
+								sum += pTexture->Sample(uv).r;
+							}
+							return sum;
+						});
+				}
+
+				delete pTexture;
+			}
+		}
+
+		//MaterialTexture::Sample, what PixelShading fetches, with every filter.
+		//Pixel footprints in texels of the full level: x and y extent of one pixel step
+		const std::tuple<const char*, float, float> footprints[]
+		{
+			{ "magnified", 0.5f, 0.5f },
+			{ "minified", 4.f, 4.f },
+			{ "anisotropic", 8.f, 1.f }
+		};
+		const std::pair<MaterialTexture::Filter, const char*> filters[]
+		{
+			{ MaterialTexture::Filter::Point, "point" },
+			{ MaterialTexture::Filter::Linear, "linear" },
+			{ MaterialTexture::Filter::Anisotropic, "anisotropic" }
+		};
+		constexpr int side{ 128 };
+		const size_t numPixels{ size_t(side) * side };
+		for (const int size : { 256, 2048 })
+		{
+			//Same size maps, packed like the vehicle's
+			const Texture* pMaps[4]{};
+			for (const Texture*& pMap : pMaps)
+			{
+				pMap = createNoiseTexture(size, Texture::Layout::Tiled);
+			}
+			MaterialTexture* pMaterial{ MaterialTexture::Create(pMaps[0], pMaps[1], pMaps[2], pMaps[3]) };
+			for (const Texture* pMap : pMaps)
+			{
+				delete pMap;
+			}
+			MaterialTexture& material{ *pMaterial };
+
+			const std::string suffix{ '/' + std::to_string(size) };
+			for (const auto& [footprintName, texelsX, texelsY] : footprints)
+			{
+				const Vector2 dUVdx{ texelsX / size, 0.f };
+				const Vector2 dUVdy{ 0.f, texelsY / size };
+				const auto uvs{ createUVs(side, { uvDistribution(random), uvDistribution(random) }, dUVdx, dUVdy) };
+
+				for (const auto& [filter, filterName] : filters)
+				{
+					material.SetFilter(filter);
+					const std::string prefix{ std::string{ "material_sample/" } + filterName + '/' + footprintName + '/' };
+					for (size_t order{}; order < uvs.size(); ++order)
+					{
+						Measure(prefix + orderNames[order] + suffix, numPixels, [&]()
+							{
+								float sum{};
+								int numFetches{};
+								for (const Vector2& uv : uvs[order])
+								{
+									sum += material.Sample(uv, dUVdx, dUVdy, numFetches).diffuse.r;
+								}
+								return sum + float(numFetches);
+							});
+					}
+				}
+			}
+
+			delete pMaterial;
+		}
+	}
+
+	void KernelBenchmarks::RunPixelShading(Renderer& renderer)
+	{
+		std::mt19937 random{ 4 };
+		const Renderer::LightMode previousLightMode{ renderer.m_LightMode };
+
+		//Square patches of pixels over the whole uv range, neighbouring pixels sample neighbouring texels like in a triangle
+		for (const int side : { 16, 64, 256 })
+		{
+			const size_t numPixels{ size_t(side) * side };
+			const Vector2 dUVdx{ 1.f / side, 0.f };
+			const Vector2 dUVdy{ 0.f, 1.f / side };
+
+			std::vector<Vertex_Out> pixels(numPixels);
+			for (int y{}; y < side; ++y)
+			{
+				for (int x{}; x < side; ++x)
+				{
+					//Random directions, so about half of the normals face away from the light like on a real mesh
+					Vertex_Out& pixel{ pixels[size_t(y) * side + x] };
+					pixel.uv = { (x + 0.5f) / side, (y + 0.5f) / side };
+					pixel.normal = RandomUnitVector(random);
+					pixel.tangent = Vector3::Cross(pixel.normal, RandomUnitVector(random)).Normalized();
+					pixel.viewDirection = RandomUnitVector(random);
+				}
+			}
+
+			const std::pair<Renderer::LightMode, const char*> lightModes[]
+			{
+				{ Renderer::LightMode::ObservedArea, "observed_area" },
+				{ Renderer::LightMode::Diffuse, "diffuse" },
+				{ Renderer::LightMode::Specular, "specular" },
+				{ Renderer::LightMode::Combined, "combined" }
+			};
+			for (const auto& [lightMode, lightModeName] : lightModes)
+			{
+				renderer.m_LightMode = lightMode;
+				Measure(std::string{ "pixel_shading/" } + lightModeName + '/' + std::to_string(numPixels), numPixels, [&]()
+					{
+						float sum{};
+						int numTexelFetches{};
+						for (const Vertex_Out& pixel : pixels)
+						{
+							sum += renderer.PixelShading(pixel, dUVdx, dUVdy, numTexelFetches).r;
+						}
+						return sum + float(numTexelFetches);
+					});
+			}
+		}
+
+		renderer.m_LightMode = previousLightMode;
+	}
+
+	bool KernelBenchmarks::WriteJson(const std::string& path) const
+	{
+		std::ofstream file{ path };
+		if (!file)
+			return false;
+
+		//An object per kernel, keyed by its name, so IsRegression can look it up with Benchmark::FindJsonNumber
+		file << "{\n";
+		file << "  \"kernels\": {\n";
+		for (size_t i{}; i < m_Results.size(); ++i)
+		{
+			const Result& result{ m_Results[i] };
+			file << "    \"" << Benchmark::EscapeJson(result.name) << "\": { \"ns_per_op\": " << result.nsPerOp
+				<< ", \"items_per_s\": " << result.itemsPerSecond << " }" << (i + 1 < m_Results.size() ? ",\n" : "\n");
+		}
+		file << "  }\n";
+		file << "}\n";
+
+		return bool(file);
+	}
+
+	bool KernelBenchmarks::IsRegression(const std::vector<Result>& results, const std::string& baselineJson, float tolerance)
+	{
+		//No short circuit, every regression gets printed
+		bool isRegression{ false };
+		for (const Result& result : results)
+		{
+			const size_t kernelPosition{ baselineJson.find('"' + Benchmark::EscapeJson(result.name) + '"') };
+			float baselineNsPerOp{};
+			if (kernelPosition == std::string::npos || !Benchmark::FindJsonNumber(baselineJson, "ns_per_op", baselineNsPerOp, kernelPosition))
+				continue;
+
+			isRegression |= Benchmark::IsWorse(result.name + "/ns_per_op", float(result.nsPerOp), baselineNsPerOp, tolerance, false);
+		}
+
+		return isRegression;
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Renderer;
+
+namespace dae
+{
+	//Times the low level kernels of the software rasterizer on their own, so a regression shows up in the kernel
+	//that caused it instead of only in the frame time of Benchmark. Every kernel runs over a few input sizes,
+	//the small ones stay in the L1/L2 caches, the big ones don't
+	class KernelBenchmarks final
+	{
+	public:
+		struct Result
+		{
+			//kernel/variant/size, e.g. texture_sample/tiled_layout/random/1024
+			std::string name{};
+			double nsPerOp{};
+			double itemsPerSecond{};
+		};
+
+		//Every measurement repeats its kernel until at least this much time has passed
+		explicit KernelBenchmarks(float minSecondsPerKernel = 0.1f);
+
+		//Matrix::operator*, Matrix::TransformPoint and its batches, Matrix::Inverse and Vector3::Normalize
+		void RunMath();
+		//Renderer::SetupTriangle, and the scalar and AVX2 tile kernels over a triangle per block size
+		void RunRasterizer(Renderer& renderer);
+		//Texture::Sample on both texel layouts, and MaterialTexture::Sample with every filter at magnified, minified and
+		//anisotropic footprints. Linear, tiled and random access over several texture sizes
+		void RunTextureSampling();
+		//Renderer::PixelShading in every light mode, with the material of the renderer
+		void RunPixelShading(Renderer& renderer);
+
+		const std::vector<Result>& GetResults() const { return m_Results; };
+
+		bool WriteJson(const std::string& path) const;
+		//Prints every kernel that got slower than the baseline by more than tolerance (0.05 = 5%), kernels missing in either are skipped.
+		//baselineJson is the text of a json written by WriteJson, see Benchmark::ReadJson
+		static bool IsRegression(const std::vector<Result>& results, const std::string& baselineJson, float tolerance);
+
+	private:
+		float m_MinSeconds;
+		std::vector<Result> m_Results{};
+
+		//pass() runs the kernel once over all numItems inputs and returns something that depends on the results
+		template<typename Pass>
+		void Measure(const std::string& name, size_t numItems, Pass pass);
+	};
+}
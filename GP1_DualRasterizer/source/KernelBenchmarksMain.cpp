@@ -0,0 +1,127 @@
+#include "pch.h"
+
+#undef main
+#include "Renderer.h"
+#include "KernelBenchmarks.h"
+#include "Benchmark.h"
+#include "CommandLine.h"
+#include <fstream>
+
+using namespace dae;
+
+//KERNEL BENCHMARKS
+//Entry point of the KernelBenchmarks project, times the rasterizer kernels without rendering a frame:
+//  --output <file>      json with ns/op and items/s of every kernel
+//  --baseline <file>    json of an earlier run, the exit code is 1 when a kernel got slower
+//  --tolerance <factor> allowed slowdown against the baseline, default 0.1 (kernels are noisier than whole frames)
+//  --min-time <seconds> time spent on every kernel and size, default 0.1
+//  --diffuse, --normal, --specular, --gloss, --mesh <file>   material PixelShading samples, default the vehicle
+struct KernelBenchmarkOptions
+{
+	SoftwareScene scene{};
+	std::string outputPath{};
+	std::string baselinePath{};
+	float tolerance{ 0.1f };
+	float minSeconds{ 0.1f };
+};
+
+static bool ParseKernelBenchmarkOptions(int argc, char* args[], KernelBenchmarkOptions& options)
+{
+	for (int i{ 1 }; i < argc; ++i)
+	{
+		const std::string option{ args[i] };
+		if (i + 1 >= argc)
+		{
+			std::cout << "Missing value for " << option << '\n';
+			return false;
+		}
+		const std::string value{ args[++i] };
+
+		if (option == "--output")
+			options.outputPath = value;
+		else if (option == "--baseline")
+			options.baselinePath = value;
+		else if (option == "--tolerance")
+		{
+			if (!ParseNumber(option, value, options.tolerance))
+				return false;
+		}
+		else if (option == "--min-time")
+		{
+			if (!ParseNumber(option, value, options.minSeconds))
+				return false;
+		}
+		else if (option == "--mesh")
+			options.scene.meshPath = value;
+		else if (option == "--diffuse")
+			options.scene.diffusePath = value;
+		else if (option == "--normal")
+			options.scene.normalPath = value;
+		else if (option == "--specular")
+			options.scene.specularPath = value;
+		else if (option == "--gloss")
+			options.scene.glossPath = value;
+		else
+		{
+			std::cout << "Unknown option " << option << '\n';
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char* args[])
+{
+	KernelBenchmarkOptions options{};
+	if (!ParseKernelBenchmarkOptions(argc, args, options))
+		return 1;
+
+	std::string baseline{};
+	if (!options.baselinePath.empty() && (!Benchmark::ReadJson(options.baselinePath, baseline) || baseline.find("\"ns_per_op\"") == std::string::npos))
+	{
+		std::cout << "Could not read the baseline " << options.baselinePath << '\n';
+		return 1;
+	}
+
+	for (const std::string& path : { options.scene.meshPath, options.scene.diffusePath, options.scene.normalPath,
+		options.scene.specularPath, options.scene.glossPath })
+	{
+		if (!std::ifstream{ path })
+		{
+			std::cout << "Could not open " << path << '\n';
+			return 1;
+		}
+	}
+
+	SDL_Init(0);
+
+	KernelBenchmarks benchmarks{ options.minSeconds };
+	benchmarks.RunMath();
+	benchmarks.RunTextureSampling();
+
+	//Only for its kernels, buffers and material, no frame gets rendered. Big enough for the largest triangle
+	const auto pRenderer = new Renderer(256, 256, options.scene);
+	if (!pRenderer->IsInitialized())
+	{
+		std::cout << "Could not load the scene: " << SDL_GetError() << '\n';
+		delete pRenderer;
+		SDL_Quit();
+		return 1;
+	}
+	benchmarks.RunRasterizer(*pRenderer);
+	benchmarks.RunPixelShading(*pRenderer);
+	delete pRenderer;
+
+	SDL_Quit();
+
+	if (!options.outputPath.empty() && !benchmarks.WriteJson(options.outputPath))
+	{
+		std::cout << "Could not write " << options.outputPath << '\n';
+		return 1;
+	}
+
+	if (!options.baselinePath.empty() && KernelBenchmarks::IsRegression(benchmarks.GetResults(), baseline, options.tolerance))
+		return 1;
+
+	return 0;
+}
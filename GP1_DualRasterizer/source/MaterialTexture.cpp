@@ -0,0 +1,84 @@
+#include "pch.h"
+#include "MaterialTexture.h"
+#include "Texture.h"
+
+using namespace dae;
+
+MaterialTexture* MaterialTexture::Create(const Texture* pDiffuse, const Texture* pNormal, const Texture* pSpecular, const Texture* pGloss)
+{
+	//The maps can come from the command line, a smaller one would be read out of bounds for every texel of the diffuse map
+	for (const Texture* pTexture : { pNormal, pSpecular, pGloss })
+	{
+		if (pTexture->GetNumMipLevels() != pDiffuse->GetNumMipLevels() ||
+			pTexture->GetWidth(0) != pDiffuse->GetWidth(0) || pTexture->GetHeight(0) != pDiffuse->GetHeight(0))
+			return nullptr;
+	}
+
+	return new MaterialTexture{ pDiffuse, pNormal, pSpecular, pGloss };
+}
+
+MaterialTexture::MaterialTexture(const Texture* pDiffuse, const Texture* pNormal, const Texture* pSpecular, const Texture* pGloss)
+{
+	using namespace TextureSampling;
+
+	size_t totalTexels{};
+	for (int level{}; level < pDiffuse->GetNumMipLevels(); ++level)
+	{
+		const int width{ pDiffuse->GetWidth(level) };
+		const int height{ pDiffuse->GetHeight(level) };
+		m_MipLevels.push_back({ width, height, GetNumTiles(width), nullptr });
+		totalTexels += size_t(GetNumTiles(width)) * GetNumTiles(height) * g_TileSize * g_TileSize;
+	}
+
+	m_pTexels = new uint64_t[totalTexels]{};
+	uint64_t* pLevelTexels{ m_pTexels };
+	for (int level{}; level < GetNumMipLevels(); ++level)
+	{
+		MipLevel& mip{ m_MipLevels[level] };
+		mip.pTexels = pLevelTexels;
+
+		//Padding texels stay zero, they're never addressed
+		for (int y{}; y < mip.height; ++y)
+		{
+			for (int x{}; x < mip.width; ++x)
+			{
+				const uint64_t diffuse{ pDiffuse->FetchPacked(level, x, y) & 0xFFFFFF };
+				const uint64_t specular{ pSpecular->FetchPacked(level, x, y) & 0xFF };
+				const uint64_t normal{ pNormal->FetchPacked(level, x, y) & 0xFFFF };
+				const uint64_t gloss{ pGloss->FetchPacked(level, x, y) & 0xFF };
+				pLevelTexels[TiledIndex(x, y, mip.tilesX)] = diffuse | specular << 24 | normal << 32 | gloss << 48;
+			}
+		}
+
+		pLevelTexels += size_t(mip.tilesX) * GetNumTiles(mip.height) * g_TileSize * g_TileSize;
+	}
+}
+
+MaterialTexture::~MaterialTexture()
+{
+	delete[] m_pTexels;
+	m_pTexels = nullptr;
+}
+
+MaterialSample MaterialTexture::Fetch(int level, int x, int y) const
+{
+	const MipLevel& mip{ m_MipLevels[level] };
+	const uint64_t texel{ mip.pTexels[TextureSampling::TiledIndex(x, y, mip.tilesX)] };
+
+	constexpr float toUnit{ 1.f / 255.f };
+	MaterialSample sample{};
+	sample.diffuse = { (texel & 0xFF) * toUnit, ((texel >> 8) & 0xFF) * toUnit, ((texel >> 16) & 0xFF) * toUnit };
+	sample.specular = ((texel >> 24) & 0xFF) * toUnit;
+	sample.normal = { ((texel >> 32) & 0xFF) * toUnit * 2.f - 1.f, ((texel >> 40) & 0xFF) * toUnit * 2.f - 1.f, 0.f };
+	sample.gloss = ((texel >> 48) & 0xFF) * toUnit;
+	return sample;
+}
+
+MaterialSample MaterialTexture::Sample(const dae::Vector2& uv, const dae::Vector2& dUVdx, const dae::Vector2& dUVdy, int& numFetches) const
+{
+	MaterialSample sample{ TextureSampling::Sample(*this, m_Filter, uv, dUVdx, dUVdy, numFetches) };
+
+	//Z of a tangent space normal always points out of the surface
+	sample.normal.z = std::sqrt(std::max(0.f, 1.f - sample.normal.x * sample.normal.x - sample.normal.y * sample.normal.y));
+	return sample;
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+#include "ColorRGB.h"
+#include "Vector3.h"
+#include "TextureSampling.h"
+
+using namespace dae;
+
+class Texture;
+
+//Everything PixelShading reads from the material maps at one uv
+struct MaterialSample
+{
+	ColorRGB diffuse{};
+	//Tangent space, [-1, 1]
+	Vector3 normal{};
+	float specular{};
+	float gloss{};
+
+	MaterialSample operator+(const MaterialSample& other) const
+	{
+		return { diffuse + other.diffuse, normal + other.normal, specular + other.specular, gloss + other.gloss };
+	}
+
+	MaterialSample operator*(float scale) const
+	{
+		return { diffuse * scale, normal * scale, specular * scale, gloss * scale };
+	}
+};
+
+//The four vehicle maps interleaved into one 8 byte texel, so shading a pixel is one fetch instead of four.
+//Per texel: diffuse RGB, specular, normal XY (Z is rebuilt, the normal is unit length), gloss and one unused byte.
+//Specular and gloss are greyscale maps, only their red channel is kept
+class MaterialTexture final
+{
+public:
+	using Filter = TextureSampling::Filter;
+
+	//All maps need the same size, the mip chains are packed level by level. nullptr when they don't match
+	static MaterialTexture* Create(const Texture* pDiffuse, const Texture* pNormal, const Texture* pSpecular, const Texture* pGloss);
+	~MaterialTexture();
+
+	MaterialTexture(const MaterialTexture&) = delete;
+	MaterialTexture(MaterialTexture&&) noexcept = delete;
+	MaterialTexture& operator=(const MaterialTexture&) = delete;
+	MaterialTexture& operator=(MaterialTexture&&) noexcept = delete;
+
+	//Filtered, the mip level comes from the screen space uv derivatives. numFetches gets the texels read added
+	MaterialSample Sample(const dae::Vector2& uv, const dae::Vector2& dUVdx, const dae::Vector2& dUVdy, int& numFetches) const;
+	void SetFilter(Filter filter) { m_Filter = filter; };
+	Filter GetFilter() const { return m_Filter; };
+
+	//Sampling source, see TextureSampling.h
+	int GetNumMipLevels() const { return int(m_MipLevels.size()); };
+	int GetWidth(int level) const { return m_MipLevels[level].width; };
+	int GetHeight(int level) const { return m_MipLevels[level].height; };
+	MaterialSample Fetch(int level, int x, int y) const;
+
+private:
+	MaterialTexture(const Texture* pDiffuse, const Texture* pNormal, const Texture* pSpecular, const Texture* pGloss);
+
+	struct MipLevel
+	{
+		int width{};
+		int height{};
+		int tilesX{};
+		const uint64_t* pTexels{ nullptr };
+	};
+
+	//Tiled like Texture, 4x4 texels per block
+	uint64_t* m_pTexels{ nullptr };
+	std::vector<MipLevel> m_MipLevels{};
+	Filter m_Filter{ Filter::Point };
+};
\ No newline at end of file
@@ -1,65 +1,415 @@
 #pragma once
+#include <cassert>
+#include <cmath>
+#include <span>
+#include <type_traits>
+#include "MathHelpers.h"
 #include "Vector3.h"
 #include "Vector4.h"
 
+//Every x64 cpu has SSE, the scalar code stays for other targets and for constant evaluation
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define USE_SSE_MATRIX
+#endif
+
 namespace dae {
+	//Header only like the vectors: everything without a sqrt, sin or cos is constexpr.
+	//At runtime the multiply and transforms take the SSE path, at compile time the scalar one, both give the same bits
 	struct Matrix
 	{
-		Matrix() = default;
-		Matrix(
+		constexpr Matrix() = default;
+		constexpr Matrix(
 			const Vector3& xAxis,
 			const Vector3& yAxis,
 			const Vector3& zAxis,
-			const Vector3& t);
+			const Vector3& t) :
+			Matrix({ xAxis, 0 }, { yAxis, 0 }, { zAxis, 0 }, { t, 1 })
+		{
+		}
 
-		Matrix(
+		constexpr Matrix(
 			const Vector4& xAxis,
 			const Vector4& yAxis,
 			const Vector4& zAxis,
-			const Vector4& t);
-
-		Matrix(const Matrix& m);
-
-		Vector3 TransformVector(const Vector3& v) const;
-		Vector3 TransformVector(float x, float y, float z) const;
-		Vector3 TransformPoint(const Vector3& p) const;
-		Vector3 TransformPoint(float x, float y, float z) const;
-
-		Vector4 TransformPoint(const Vector4& p) const;
-		Vector4 TransformPoint(float x, float y, float z, float w) const;
-
-		const Matrix& Transpose();
-		const Matrix& Inverse();
-
-		Vector3 GetAxisX() const;
-		Vector3 GetAxisY() const;
-		Vector3 GetAxisZ() const;
-		Vector3 GetTranslation() const;
-
-		static Matrix CreateTranslation(float x, float y, float z);
-		static Matrix CreateTranslation(const Vector3& t);
-		static Matrix CreateRotationX(float pitch);
-		static Matrix CreateRotationY(float yaw);
-		static Matrix CreateRotationZ(float roll);
-		static Matrix CreateRotation(float pitch, float yaw, float roll);
-		static Matrix CreateRotation(const Vector3& r);
-		static Matrix CreateScale(float sx, float sy, float sz);
-		static Matrix CreateScale(const Vector3& s);
-		static Matrix Transpose(const Matrix& m);
-		static Matrix Inverse(const Matrix& m);
-
-		static Matrix CreateLookAtLH(const Vector3& origin, const Vector3& forward, const Vector3& up);
-		static Matrix CreatePerspectiveFovLH(float fovy, float aspect, float zn, float zf);
-
-		Vector4& operator[](int index);
-		Vector4 operator[](int index) const;
-		Matrix operator*(const Matrix& m) const;
-		const Matrix& operator*=(const Matrix& m);
+			const Vector4& t) :
+			data{ xAxis, yAxis, zAxis, t }
+		{
+		}
+
+		constexpr Matrix(const Matrix& m) = default;
+		constexpr Matrix& operator=(const Matrix& m) = default;
+
+		constexpr Vector3 TransformVector(const Vector3& v) const
+		{
+			return TransformVector(v.x, v.y, v.z);
+		}
+
+		constexpr Vector3 TransformVector(float x, float y, float z) const
+		{
+#if defined(USE_SSE_MATRIX)
+			if (!std::is_constant_evaluated())
+				return StoreVector3(CombineRows(LoadRows(data), x, y, z));
+#endif
+			return Vector3{
+				data[0].x * x + data[1].x * y + data[2].x * z,
+				data[0].y * x + data[1].y * y + data[2].y * z,
+				data[0].z * x + data[1].z * y + data[2].z * z
+			};
+		}
+
+		constexpr Vector3 TransformPoint(const Vector3& p) const
+		{
+			return TransformPoint(p.x, p.y, p.z);
+		}
+
+		constexpr Vector3 TransformPoint(float x, float y, float z) const
+		{
+#if defined(USE_SSE_MATRIX)
+			if (!std::is_constant_evaluated())
+			{
+				const MatrixRows m{ LoadRows(data) };
+				return StoreVector3(_mm_add_ps(CombineRows(m, x, y, z), m.rows[3]));
+			}
+#endif
+			return Vector3{
+				data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
+				data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
+				data[0].z * x + data[1].z * y + data[2].z * z + data[3].z,
+			};
+		}
+
+		constexpr Vector4 TransformPoint(const Vector4& p) const
+		{
+			return TransformPoint(p.x, p.y, p.z, p.w);
+		}
+
+		//w is taken as 1, the translation row is added as is
+		constexpr Vector4 TransformPoint(float x, float y, float z, [[maybe_unused]] float w) const
+		{
+#if defined(USE_SSE_MATRIX)
+			if (!std::is_constant_evaluated())
+			{
+				const MatrixRows m{ LoadRows(data) };
+				//A Vector4 is only 4 byte aligned
+				Vector4 result;
+				_mm_storeu_ps(&result.x, _mm_add_ps(CombineRows(m, x, y, z), m.rows[3]));
+				return result;
+			}
+#endif
+			return Vector4{
+				data[0].x * x + data[1].x * y + data[2].x * z + data[3].x,
+				data[0].y * x + data[1].y * y + data[2].y * z + data[3].y,
+				data[0].z * x + data[1].z * y + data[2].z * z + data[3].z,
+				data[0].w * x + data[1].w * y + data[2].w * z + data[3].w
+			};
+		}
+
+		//Batches: the matrix is loaded once for the whole span instead of once per element.
+		//transformed needs at least as many elements and may be the input itself, big batches can be split over threads with subspan
+		//Homogeneous, w = 1 (clip space)
+		void TransformPoints(std::span<const Vector3> points, std::span<Vector4> transformed) const
+		{
+			assert(transformed.size() >= points.size());
+#if defined(USE_SSE_MATRIX)
+			const MatrixRows m{ LoadRows(data) };
+			for (size_t i{}; i < points.size(); ++i)
+			{
+				const Vector3& p{ points[i] };
+				_mm_storeu_ps(&transformed[i].x, _mm_add_ps(CombineRows(m, p.x, p.y, p.z), m.rows[3]));
+			}
+#else
+			for (size_t i{}; i < points.size(); ++i)
+			{
+				transformed[i] = TransformPoint(points[i].x, points[i].y, points[i].z, 1.f);
+			}
+#endif
+		}
+
+		void TransformPoints(std::span<const Vector3> points, std::span<Vector3> transformed) const
+		{
+			assert(transformed.size() >= points.size());
+#if defined(USE_SSE_MATRIX)
+			const MatrixRows m{ LoadRows(data) };
+			for (size_t i{}; i < points.size(); ++i)
+			{
+				const Vector3& p{ points[i] };
+				transformed[i] = StoreVector3(_mm_add_ps(CombineRows(m, p.x, p.y, p.z), m.rows[3]));
+			}
+#else
+			for (size_t i{}; i < points.size(); ++i)
+			{
+				transformed[i] = TransformPoint(points[i]);
+			}
+#endif
+		}
+
+		void TransformVectors(std::span<const Vector3> vectors, std::span<Vector3> transformed) const
+		{
+			assert(transformed.size() >= vectors.size());
+#if defined(USE_SSE_MATRIX)
+			const MatrixRows m{ LoadRows(data) };
+			for (size_t i{}; i < vectors.size(); ++i)
+			{
+				const Vector3& v{ vectors[i] };
+				transformed[i] = StoreVector3(CombineRows(m, v.x, v.y, v.z));
+			}
+#else
+			for (size_t i{}; i < vectors.size(); ++i)
+			{
+				transformed[i] = TransformVector(vectors[i]);
+			}
+#endif
+		}
+
+		//TransformVector and normalized, without the inverse transpose, so only for rotations and uniform scales
+		void TransformNormals(std::span<const Vector3> normals, std::span<Vector3> transformed) const
+		{
+			assert(transformed.size() >= normals.size());
+#if defined(USE_SSE_MATRIX)
+			const MatrixRows m{ LoadRows(data) };
+			for (size_t i{}; i < normals.size(); ++i)
+			{
+				const Vector3& n{ normals[i] };
+				transformed[i] = StoreVector3(NormalizeXYZ(CombineRows(m, n.x, n.y, n.z)));
+			}
+#else
+			for (size_t i{}; i < normals.size(); ++i)
+			{
+				transformed[i] = TransformVector(normals[i]).Normalized();
+			}
+#endif
+		}
+
+		constexpr const Matrix& Transpose()
+		{
+			Matrix result{};
+			for (int r{ 0 }; r < 4; ++r)
+			{
+				for (int c{ 0 }; c < 4; ++c)
+				{
+					result[r][c] = data[c][r];
+				}
+			}
+
+			data[0] = result[0];
+			data[1] = result[1];
+			data[2] = result[2];
+			data[3] = result[3];
+
+			return *this;
+		}
+
+		const Matrix& Inverse()
+		{
+			//Optimized Inverse as explained in FGED1 - used widely in other libraries too.
+			const Vector3& a = data[0];
+			const Vector3& b = data[1];
+			const Vector3& c = data[2];
+			const Vector3& d = data[3];
+
+			const float x = data[0][3];
+			const float y = data[1][3];
+			const float z = data[2][3];
+			const float w = data[3][3];
+
+			Vector3 s = Vector3::Cross(a, b);
+			Vector3 t = Vector3::Cross(c, d);
+			Vector3 u = a * y - b * x;
+			Vector3 v = c * w - d * z;
+
+			const float det = Vector3::Dot(s, v) + Vector3::Dot(t, u);
+			assert((!AreEqual(det, 0.f)) && "ERROR: determinant is 0, there is no INVERSE!");
+			const float invDet = 1.f / det;
+
+			s *= invDet; t *= invDet; u *= invDet; v *= invDet;
+
+			const Vector3 r0 = Vector3::Cross(b, v) + t * y;
+			const Vector3 r1 = Vector3::Cross(v, a) - t * x;
+			const Vector3 r2 = Vector3::Cross(d, u) + s * w;
+			//Vector3 r3 = Vector3::Cross(u, c) - s * z;
+
+			data[0] = Vector4{ r0.x, r1.x, r2.x, 0.f };
+			data[1] = Vector4{ r0.y, r1.y, r2.y, 0.f };
+			data[2] = Vector4{ r0.z, r1.z, r2.z, 0.f };
+			data[3] = { -Vector3::Dot(b, t),Vector3::Dot(a, t),-Vector3::Dot(d, s),Vector3::Dot(c, s) };
+
+			return *this;
+		}
+
+		constexpr Vector3 GetAxisX() const
+		{
+			return data[0];
+		}
+
+		constexpr Vector3 GetAxisY() const
+		{
+			return data[1];
+		}
+
+		constexpr Vector3 GetAxisZ() const
+		{
+			return data[2];
+		}
+
+		constexpr Vector3 GetTranslation() const
+		{
+			return data[3];
+		}
+
+		static constexpr Matrix CreateTranslation(float x, float y, float z)
+		{
+			return CreateTranslation({ x, y, z });
+		}
+
+		static constexpr Matrix CreateTranslation(const Vector3& t)
+		{
+			return { Vector3::UnitX, Vector3::UnitY, Vector3::UnitZ, t };
+		}
+
+		static Matrix CreateRotationX(float pitch)
+		{
+			return {
+				{1, 0, 0, 0},
+				{0, std::cos(pitch), -std::sin(pitch), 0},
+				{0, std::sin(pitch), std::cos(pitch), 0},
+				{0, 0, 0, 1}
+			};
+		}
+
+		static Matrix CreateRotationY(float yaw)
+		{
+			return {
+				{std::cos(yaw), 0, -std::sin(yaw), 0},
+				{0, 1, 0, 0},
+				{std::sin(yaw), 0, std::cos(yaw), 0},
+				{0, 0, 0, 1}
+			};
+		}
+
+		static Matrix CreateRotationZ(float roll)
+		{
+			return {
+				{std::cos(roll), std::sin(roll), 0, 0},
+				{-std::sin(roll), std::cos(roll), 0, 0},
+				{0, 0, 1, 0},
+				{0, 0, 0, 1}
+			};
+		}
+
+		static Matrix CreateRotation(float pitch, float yaw, float roll)
+		{
+			return CreateRotation({ pitch, yaw, roll });
+		}
+
+		static Matrix CreateRotation(const Vector3& r)
+		{
+			return CreateRotationX(r[0]) * CreateRotationY(r[1]) * CreateRotationZ(r[2]);
+		}
+
+		static constexpr Matrix CreateScale(float sx, float sy, float sz)
+		{
+			return { {sx, 0, 0}, {0, sy, 0}, {0, 0, sz}, Vector3::Zero };
+		}
+
+		static constexpr Matrix CreateScale(const Vector3& s)
+		{
+			return CreateScale(s[0], s[1], s[2]);
+		}
+
+		static constexpr Matrix Transpose(const Matrix& m)
+		{
+			Matrix out{ m };
+			out.Transpose();
+
+			return out;
+		}
+
+		static Matrix Inverse(const Matrix& m)
+		{
+			Matrix out{ m };
+			out.Inverse();
+
+			return out;
+		}
+
+		static Matrix CreateLookAtLH(const Vector3& origin, const Vector3& forward, const Vector3& up)
+		{
+			const Vector3 zAxis{ forward };
+			const Vector3 xAxis{ Vector3::Cross(up, zAxis).Normalized() };
+			const Vector3 yAxis{ Vector3::Cross(zAxis, xAxis) };
+
+			return Matrix{ {xAxis.x, yAxis.x, zAxis.x, 0},
+				{xAxis.y, yAxis.y, zAxis.y, 0} ,
+				{xAxis.z, yAxis.z, zAxis.z, 0 },
+				{ -Vector3::Dot(xAxis, origin), -Vector3::Dot(yAxis, origin), -Vector3::Dot(zAxis, origin), 1} };
+		}
+
+		static constexpr Matrix CreatePerspectiveFovLH(float fov, float aspect, float zn, float zf)
+		{
+			return {
+				{1.f / (aspect * fov), 0.f, 0.f, 0.f},
+				{0.f, 1.f / fov, 0.f, 0.f},
+				{0.f, 0.f, zf / (zf - zn), 1.f},
+				{0.f, 0.f, -(zf * zn) / (zf - zn), 0.f},
+			};
+		}
+
+#pragma region Operator Overloads
+		constexpr Vector4& operator[](int index)
+		{
+			assert(index <= 3 && index >= 0);
+			return data[index];
+		}
+
+		constexpr Vector4 operator[](int index) const
+		{
+			assert(index <= 3 && index >= 0);
+			return data[index];
+		}
+
+		constexpr Matrix operator*(const Matrix& m) const
+		{
+			Matrix result{};
+#if defined(USE_SSE_MATRIX)
+			if (!std::is_constant_evaluated())
+			{
+				//Row r of the result is data[r].x * m[0] + data[r].y * m[1] + ..., the same sums as the dot products with the columns
+				const MatrixRows rows{ LoadRows(m.data) };
+				for (int r{ 0 }; r < 4; ++r)
+				{
+					const __m128 row{ _mm_add_ps(CombineRows(rows, data[r].x, data[r].y, data[r].z),
+						_mm_mul_ps(rows.rows[3], _mm_set1_ps(data[r].w))) };
+					//data is alignas(16), so every row of result is too
+					_mm_store_ps(&result.data[r].x, row);
+				}
+				return result;
+			}
+#endif
+			const Matrix m_transposed = Transpose(m);
+
+			for (int r{ 0 }; r < 4; ++r)
+			{
+				for (int c{ 0 }; c < 4; ++c)
+				{
+					result[r][c] = Vector4::Dot(data[r], m_transposed[c]);
+				}
+			}
+
+			return result;
+		}
+
+		constexpr const Matrix& operator*=(const Matrix& m)
+		{
+			*this = *this * m;
+			return *this;
+		}
+#pragma endregion
 
 	private:
 
-		//Row-Major Matrix
-		Vector4 data[4]
+		//Row-Major Matrix, rows 16 byte aligned so the SSE code loads and stores them whole
+		alignas(16) Vector4 data[4]
 		{
 			{1,0,0,0}, //xAxis
 			{0,1,0,0}, //yAxis
@@ -71,5 +421,44 @@ namespace dae {
 		// v1x v1y v1z v1w
 		// v2x v2y v2z v2w
 		// v3x v3y v3z v3w
+
+#if defined(USE_SSE_MATRIX)
+		struct MatrixRows
+		{
+			__m128 rows[4];
+		};
+
+		static MatrixRows LoadRows(const Vector4* pRows)
+		{
+			return { _mm_load_ps(&pRows[0].x), _mm_load_ps(&pRows[1].x), _mm_load_ps(&pRows[2].x), _mm_load_ps(&pRows[3].x) };
+		}
+
+		//A row times x + the next row times y + ..., one lane per column.
+		//Multiplies and adds stay separate (no fma) and add up in the same order as the scalar code, so the results are bit identical
+		static __m128 CombineRows(const MatrixRows& m, float x, float y, float z)
+		{
+			__m128 result{ _mm_mul_ps(m.rows[0], _mm_set1_ps(x)) };
+			result = _mm_add_ps(result, _mm_mul_ps(m.rows[1], _mm_set1_ps(y)));
+			result = _mm_add_ps(result, _mm_mul_ps(m.rows[2], _mm_set1_ps(z)));
+			return result;
+		}
+
+		//x, y and z divided by their length, same sum order and correctly rounded sqrt and divide as Vector3::Normalized
+		static __m128 NormalizeXYZ(__m128 v)
+		{
+			const __m128 squared{ _mm_mul_ps(v, v) };
+			__m128 length{ _mm_add_ss(_mm_add_ss(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(1, 1, 1, 1))),
+				_mm_shuffle_ps(squared, squared, _MM_SHUFFLE(2, 2, 2, 2))) };
+			length = _mm_sqrt_ss(length);
+			return _mm_div_ps(v, _mm_shuffle_ps(length, length, _MM_SHUFFLE(0, 0, 0, 0)));
+		}
+
+		static Vector3 StoreVector3(__m128 v)
+		{
+			alignas(16) float result[4];
+			_mm_store_ps(result, v);
+			return Vector3{ result[0], result[1], result[2] };
+		}
+#endif
 	};
-}
\ No newline at end of file
+}
@@ -8,7 +8,7 @@ struct MeshRast final
 	std::vector<uint32_t> indices{};
 	PrimitiveTopology primitiveTopology{ PrimitiveTopology::TriangleStrip };
 
-	std::vector<Vertex_Out> vertices_out{};
+	VertexStreams streams{};
 	Matrix worldMatrix{};
 };
 
@@ -0,0 +1,111 @@
+#include "pch.h"
+#include "Profiler.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+
+namespace dae
+{
+	namespace Profiler
+	{
+		//Zones per thread before the oldest get overwritten
+		constexpr uint32_t g_RingBufferSize{ 1 << 16 };
+
+		struct Zone
+		{
+			const char* name{};
+			uint64_t start{};
+			uint64_t end{};
+		};
+
+		//Only the owning thread writes, the exporter reads up to the published count
+		struct ThreadBuffer
+		{
+			uint32_t threadId{};
+			std::string name{};
+			Zone zones[g_RingBufferSize]{};
+			std::atomic<uint64_t> numZones{};
+		};
+
+		static const std::chrono::steady_clock::time_point g_StartTime{ std::chrono::steady_clock::now() };
+
+		//Buffers are never freed, a trace can still show threads that are gone
+		static std::mutex g_BuffersMutex{};
+		static std::vector<ThreadBuffer*> g_pBuffers{};
+
+		static ThreadBuffer& GetThreadBuffer()
+		{
+			//Registered once per thread, after that recording is lock free
+			thread_local ThreadBuffer* pBuffer{ nullptr };
+			if (!pBuffer)
+			{
+				pBuffer = new ThreadBuffer{};
+
+				std::lock_guard lock{ g_BuffersMutex };
+				pBuffer->threadId = uint32_t(g_pBuffers.size());
+				pBuffer->name = "Thread " + std::to_string(pBuffer->threadId);
+				g_pBuffers.push_back(pBuffer);
+			}
+			return *pBuffer;
+		}
+
+		uint64_t GetTimestamp()
+		{
+			return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_StartTime).count());
+		}
+
+		void RecordZone(const char* name, uint64_t start, uint64_t end)
+		{
+			ThreadBuffer& buffer{ GetThreadBuffer() };
+			const uint64_t index{ buffer.numZones.load(std::memory_order_relaxed) };
+			buffer.zones[index % g_RingBufferSize] = { name, start, end };
+			buffer.numZones.store(index + 1, std::memory_order_release);
+		}
+
+		void SetThreadName(const char* name)
+		{
+			ThreadBuffer& buffer{ GetThreadBuffer() };
+			std::lock_guard lock{ g_BuffersMutex };
+			buffer.name = name;
+		}
+
+		bool WriteChromeTrace(const std::string& path)
+		{
+			if (!IsEnabled())
+			{
+				std::cout << "The profiler is compiled out, build Release with /p:EnableProfiler=true to record a trace\n";
+				return false;
+			}
+
+			std::ofstream file{ path };
+			if (!file)
+				return false;
+
+			//Complete events ("X") in microseconds, plus a thread name per buffer
+			std::lock_guard lock{ g_BuffersMutex };
+			file << std::fixed << std::setprecision(3);
+			file << "{\"traceEvents\":[\n";
+			bool isFirst{ true };
+			for (const ThreadBuffer* pBuffer : g_pBuffers)
+			{
+				file << (isFirst ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << pBuffer->threadId
+					<< ",\"args\":{\"name\":\"" << pBuffer->name << "\"}}";
+				isFirst = false;
+
+				const uint64_t numZones{ pBuffer->numZones.load(std::memory_order_acquire) };
+				const uint64_t first{ numZones > g_RingBufferSize ? numZones - g_RingBufferSize : 0 };
+				for (uint64_t i{ first }; i < numZones; ++i)
+				{
+					const Zone& zone{ pBuffer->zones[i % g_RingBufferSize] };
+					file << ",\n{\"name\":\"" << zone.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << pBuffer->threadId
+						<< ",\"ts\":" << zone.start / 1000.0 << ",\"dur\":" << (zone.end - zone.start) / 1000.0 << '}';
+				}
+			}
+			file << "\n]}\n";
+
+			return bool(file);
+		}
+	}
+}
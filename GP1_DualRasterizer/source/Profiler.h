@@ -0,0 +1,70 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <string>
+
+//Define ENABLE_PROFILER to record PROFILE_ZONE scopes, Release builds do with msbuild /p:EnableProfiler=true (DirectX_Release.props).
+//Without it the macros expand to nothing, so the zones can stay in the hot paths
+#if defined(ENABLE_PROFILER)
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+//name has to be a string literal (or live as long as the program), only the pointer is stored
+#define PROFILE_ZONE(name) const dae::ProfileZone PROFILE_CONCAT(profileZone, __LINE__){ name }
+#define PROFILE_THREAD_NAME(name) dae::Profiler::SetThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+#endif
+
+namespace dae
+{
+	//Every thread records its zones into its own ring buffer, so recording takes no lock.
+	//The oldest zones get overwritten once a buffer is full
+	namespace Profiler
+	{
+		constexpr bool IsEnabled()
+		{
+#if defined(ENABLE_PROFILER)
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		//Nanoseconds since the profiler started
+		uint64_t GetTimestamp();
+		void RecordZone(const char* name, uint64_t start, uint64_t end);
+		//Shown as the name of the calling thread in the trace
+		void SetThreadName(const char* name);
+
+		//Writes the recorded zones as chrome://tracing / Perfetto json.
+		//Zones recorded while writing may be missing, so call it while the pipeline is idle
+		bool WriteChromeTrace(const std::string& path);
+	}
+
+#if defined(ENABLE_PROFILER)
+	class ProfileZone final
+	{
+	public:
+		explicit ProfileZone(const char* name) :
+			m_Name{ name },
+			m_Start{ Profiler::GetTimestamp() }
+		{
+		}
+		~ProfileZone()
+		{
+			Profiler::RecordZone(m_Name, m_Start, Profiler::GetTimestamp());
+		}
+
+		ProfileZone(const ProfileZone&) = delete;
+		ProfileZone(ProfileZone&&) noexcept = delete;
+		ProfileZone& operator=(const ProfileZone&) = delete;
+		ProfileZone& operator=(ProfileZone&&) noexcept = delete;
+
+	private:
+		const char* m_Name;
+		uint64_t m_Start;
+	};
+#endif
+}
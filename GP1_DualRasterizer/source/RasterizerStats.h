@@ -0,0 +1,57 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+
+//Counters of the software pipeline for one frame, see Renderer::GetFrameStats
+struct RasterizerStats
+{
+	//Front end, once per triangle of the meshes
+	uint64_t trianglesSubmitted{};
+	//Outside the frustum, or nothing left after clipping
+	uint64_t trianglesFrustumCulled{};
+	uint64_t trianglesClipped{};
+	uint64_t trianglesBackfaceCulled{};
+	//Zero area, repeated strip indices, or no pixel center inside
+	uint64_t trianglesDegenerate{};
+	//Set up and binned, triangles split by clipping count once per piece
+	uint64_t trianglesBinned{};
+
+	//Back end, per tile a triangle got binned into
+	uint64_t trianglesHiZCulled{};
+	//Pixel centers inside a triangle that reached the depth test (coarse blocks behind the Hi-Z are skipped before)
+	uint64_t pixelsCovered{};
+	uint64_t depthTestsPassed{};
+	uint64_t depthTestsFailed{};
+	//Pixels written at least once, what the overdraw is relative to
+	uint64_t pixelsWritten{};
+	//One MaterialTexture::Sample each
+	uint64_t pixelShadingInvocations{};
+	//Texels those samples read: 1 per point sample, 4 or 8 per trilinear one and that per tap when anisotropic.
+	//Every texel holds all four maps
+	uint64_t textureSamples{};
+
+	//Depth test passes per written pixel, 1 = every pixel was only drawn once
+	float GetOverdraw() const
+	{
+		return pixelsWritten > 0 ? float(depthTestsPassed) / float(pixelsWritten) : 0.f;
+	}
+
+	RasterizerStats& operator+=(const RasterizerStats& other)
+	{
+		trianglesSubmitted += other.trianglesSubmitted;
+		trianglesFrustumCulled += other.trianglesFrustumCulled;
+		trianglesClipped += other.trianglesClipped;
+		trianglesBackfaceCulled += other.trianglesBackfaceCulled;
+		trianglesDegenerate += other.trianglesDegenerate;
+		trianglesBinned += other.trianglesBinned;
+		trianglesHiZCulled += other.trianglesHiZCulled;
+		pixelsCovered += other.pixelsCovered;
+		depthTestsPassed += other.depthTestsPassed;
+		depthTestsFailed += other.depthTestsFailed;
+		pixelsWritten += other.pixelsWritten;
+		pixelShadingInvocations += other.pixelShadingInvocations;
+		textureSamples += other.textureSamples;
+		return *this;
+	}
+};
@@ -3,13 +3,235 @@
 #include "Renderer.h"
 #include "MeshRepresentation.h"
 #include "Texture.h"
+#include "MaterialTexture.h"
 #include "EffectShader.h"
 #include "Utils.h"
+#include "ThreadPool.h"
+#include "WorkerThread.h"
+#include "Profiler.h"
+#include <bit>
+#include <array>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
 
 HANDLE m_hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
 
 using namespace dae;
 
+//AVX2, FMA, POPCNT and BMI1 (RendererAVX2.cpp uses all of them), and an OS that saves the ymm registers
+static bool CpuHasAVX2()
+{
+#if defined(_MSC_VER)
+	int info[4]{};
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	__cpuid(info, 1);
+	const bool hasFMA{ (info[2] & (1 << 12)) != 0 };
+	const bool hasPopcnt{ (info[2] & (1 << 23)) != 0 };
+	const bool hasOSXSave{ (info[2] & (1 << 27)) != 0 };
+	const bool hasAVX{ (info[2] & (1 << 28)) != 0 };
+	if (!hasFMA || !hasPopcnt || !hasOSXSave || !hasAVX || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	//AVX2 and BMI1 (tzcnt)
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0 && (info[1] & (1 << 3)) != 0;
+#elif defined(__GNUC__)
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+		__builtin_cpu_supports("popcnt") && __builtin_cpu_supports("bmi");
+#else
+	return false;
+#endif
+}
+
+//Edge function of the screen edge from -> to, equal to Cross(to - from, p - from) * scale
+static EdgeFunction MakeEdgeFunction(const Vector4& from, const Vector4& to, float scale)
+{
+	return EdgeFunction{
+		(from.y - to.y) * scale,
+		(to.x - from.x) * scale,
+		(from.x * to.y - from.y * to.x) * scale
+	};
+}
+
+//Snapped positions have to stay in 16 integer bits, the guard band keeps every vertex well inside that
+constexpr float g_MaxFixedCoordinate{ float(1 << 15) };
+constexpr float g_GuardBandCoordinate{ g_MaxFixedCoordinate / 2 };
+
+//Clip planes in homogeneous clip space (before the perspective divide)
+enum ClipPlane : uint32_t
+{
+	ClipNear = 1 << 0,
+	ClipFar = 1 << 1,
+	ClipLeft = 1 << 2,
+	ClipRight = 1 << 3,
+	ClipBottom = 1 << 4,
+	ClipTop = 1 << 5
+};
+constexpr uint32_t g_ClipPlanes[]{ ClipNear, ClipFar, ClipLeft, ClipRight, ClipBottom, ClipTop };
+//A triangle clipped by all planes has at most 3 + 6 vertices
+constexpr int g_MaxClippedVertices{ 9 };
+
+//Signed distance of a clip space position to a plane, >= 0 is inside.
+//extent scales the x/y planes: 1 is the view frustum, the guard band is wider
+static float ClipDistance(const Vector4& position, uint32_t plane, float extent)
+{
+	switch (plane)
+	{
+	case ClipNear:
+		return position.z;
+	case ClipFar:
+		return position.w - position.z;
+	case ClipLeft:
+		return position.x + extent * position.w;
+	case ClipRight:
+		return extent * position.w - position.x;
+	case ClipBottom:
+		return position.y + extent * position.w;
+	default:
+		return extent * position.w - position.y;
+	}
+}
+
+//Bit set for every plane the position is outside of
+static uint32_t ClipCode(const Vector4& position, float extent)
+{
+	uint32_t code{};
+	for (uint32_t plane : g_ClipPlanes)
+	{
+		if (ClipDistance(position, plane, extent) < 0.f)
+			code |= plane;
+	}
+	return code;
+}
+
+//Clip space is linear, so every attribute can be interpolated with the same factor
+static Vertex_Out LerpVertex(const Vertex_Out& from, const Vertex_Out& to, float factor)
+{
+	Vertex_Out vertex{};
+	vertex.position = from.position + (to.position - from.position) * factor;
+	vertex.color = ColorRGB::Lerp(from.color, to.color, factor);
+	vertex.uv = from.uv + (to.uv - from.uv) * factor;
+	vertex.normal = from.normal + (to.normal - from.normal) * factor;
+	vertex.tangent = from.tangent + (to.tangent - from.tangent) * factor;
+	vertex.viewDirection = from.viewDirection + (to.viewDirection - from.viewDirection) * factor;
+	return vertex;
+}
+
+//Sutherland-Hodgman: clips the convex polygon against one plane, returns the new vertex count
+static int ClipPolygon(const Vertex_Out* pIn, int count, Vertex_Out* pOut, uint32_t plane, float extent)
+{
+	int outCount{};
+	for (int i{}; i < count; ++i)
+	{
+		const Vertex_Out& current{ pIn[i] };
+		const Vertex_Out& next{ pIn[(i + 1) % count] };
+		const float currentDistance{ ClipDistance(current.position, plane, extent) };
+		const float nextDistance{ ClipDistance(next.position, plane, extent) };
+
+		if (currentDistance >= 0.f)
+			pOut[outCount++] = current;
+
+		if ((currentDistance >= 0.f) != (nextDistance >= 0.f))
+			pOut[outCount++] = LerpVertex(current, next, currentDistance / (currentDistance - nextDistance));
+	}
+	return outCount;
+}
+
+//Per vertex clip codes: the frustum planes in the low bits, the guard band planes shifted up
+constexpr int g_GuardBandCodeShift{ 8 };
+constexpr uint32_t g_FrustumCodeMask{ (1u << g_GuardBandCodeShift) - 1 };
+//Vertices transformed per job of the vertex stage, a multiple of the SIMD width
+constexpr uint32_t g_VertexChunkSize{ 1024 };
+
+//Perspective divide + viewport transform, w is kept for the perspective correct interpolation
+static void ClipToScreen(Vector4& position, float width, float height)
+{
+	const float invW{ 1.f / position.w };
+	position.x = (position.x * invW + 1.f) * 0.5f * width;
+	position.y = (1.f - position.y * invW) * 0.5f * height;
+	position.z = Clamp(position.z * invW, g_MinClippedDepth, 1.f);
+}
+
+//Builds the Vertex_Out of one vertex from the streams, with its clip space position
+static Vertex_Out GatherVertex(const MeshRast& mesh, const TransformedVertexStreams& streams, uint32_t index)
+{
+	Vertex_Out vertex{};
+	vertex.position = { streams.clipX[index], streams.clipY[index], streams.clipZ[index], streams.clipW[index] };
+	vertex.uv = mesh.vertices[index].uv;
+	vertex.normal = { streams.worldNormalX[index], streams.worldNormalY[index], streams.worldNormalZ[index] };
+	vertex.tangent = { streams.worldTangentX[index], streams.worldTangentY[index], streams.worldTangentZ[index] };
+	vertex.viewDirection = { streams.viewDirectionX[index], streams.viewDirectionY[index], streams.viewDirectionZ[index] };
+	return vertex;
+}
+
+//Same, with the screen space position the vertex stage already computed
+static Vertex_Out GatherScreenVertex(const MeshRast& mesh, const TransformedVertexStreams& streams, uint32_t index)
+{
+	Vertex_Out vertex{ GatherVertex(mesh, streams, index) };
+	vertex.position = { streams.screenX[index], streams.screenY[index], streams.screenZ[index], streams.clipW[index] };
+	return vertex;
+}
+
+//Splits the vertices into streams, done once per mesh
+static void FillVertexStreams(MeshRast& mesh)
+{
+	VertexStreams& streams{ mesh.streams };
+	const size_t count{ mesh.vertices.size() };
+	for (std::vector<float>* pStream : { &streams.positionX, &streams.positionY, &streams.positionZ,
+		&streams.normalX, &streams.normalY, &streams.normalZ, &streams.tangentX, &streams.tangentY, &streams.tangentZ })
+	{
+		pStream->resize(count);
+	}
+
+	for (size_t i{}; i < count; ++i)
+	{
+		const Vertex& vertex{ mesh.vertices[i] };
+		streams.positionX[i] = vertex.position.x;
+		streams.positionY[i] = vertex.position.y;
+		streams.positionZ[i] = vertex.position.z;
+		streams.normalX[i] = vertex.normal.x;
+		streams.normalY[i] = vertex.normal.y;
+		streams.normalZ[i] = vertex.normal.z;
+		streams.tangentX[i] = vertex.tangent.x;
+		streams.tangentY[i] = vertex.tangent.y;
+		streams.tangentZ[i] = vertex.tangent.z;
+	}
+}
+
+//Sizes the vertex stage output of one frame for a mesh
+static void ResizeTransformedStreams(TransformedVertexStreams& streams, size_t count)
+{
+	for (std::vector<float>* pStream : { &streams.clipX, &streams.clipY, &streams.clipZ, &streams.clipW,
+		&streams.screenX, &streams.screenY, &streams.screenZ,
+		&streams.worldNormalX, &streams.worldNormalY, &streams.worldNormalZ,
+		&streams.worldTangentX, &streams.worldTangentY, &streams.worldTangentZ,
+		&streams.viewDirectionX, &streams.viewDirectionY, &streams.viewDirectionZ })
+	{
+		pStream->resize(count);
+	}
+	streams.clipCodes.resize(count);
+}
+
+//Integer version of MakeEdgeFunction on snapped positions, with the top-left fill rule
+static EdgeFunctionFixed MakeEdgeFunctionFixed(int64_t fromX, int64_t fromY, int64_t toX, int64_t toY)
+{
+	EdgeFunctionFixed edge{ fromY - toY, toX - fromX, fromX * toY - fromY * toX };
+
+	//Pixels exactly on a top edge (horizontal, inside below it) or a left edge (going up, inside to the right) are covered,
+	//on the other edges they belong to the neighbouring triangle
+	const bool isTopLeft{ edge.a > 0 || (edge.a == 0 && edge.b > 0) };
+	if (!isTopLeft)
+		edge.c -= 1;
+
+	return edge;
+}
+
 Renderer::Renderer(SDL_Window* pWindow) :
 	m_pWindow(pWindow)
 {
@@ -37,6 +259,13 @@ Renderer::Renderer(SDL_Window* pWindow) :
 	m_pNormalTxt = new Texture{ m_pDevice, "Resources/vehicle_normal.png" };
 	m_pSpecularTxt = new Texture{ m_pDevice, "Resources/vehicle_specular.png" };
 	m_pGlossTxt = new Texture{ m_pDevice, "Resources/vehicle_gloss.png" };
+	m_pMaterialTxt = MaterialTexture::Create(m_pDiffuseTxt, m_pNormalTxt, m_pSpecularTxt, m_pGlossTxt);
+	assert(m_pMaterialTxt != nullptr && "The vehicle maps need the same size");
+	//The software shader only samples the packed copy, the maps keep their GPU textures
+	for (Texture* pTexture : { m_pDiffuseTxt, m_pNormalTxt, m_pSpecularTxt, m_pGlossTxt })
+	{
+		pTexture->ReleaseTexels();
+	}
 
 	pShadedEffect->SetDiffuseMap(m_pDiffuseTxt);
 	pShadedEffect->SetNormalMap(m_pNormalTxt);
@@ -58,41 +287,156 @@ Renderer::Renderer(SDL_Window* pWindow) :
 
 	//Create Buffers
 	m_pFrontBuffer = SDL_GetWindowSurface(pWindow);
-	m_pBackBuffer = SDL_CreateRGBSurface(0, m_Width, m_Height, 32, 0, 0, 0, 0);
-	m_pBackBufferPixels = (uint32_t*)m_pBackBuffer->pixels;
-
-	m_pDepthBufferPixels = new float[m_Width * m_Height];
-
-	//Mesh
-	MeshRast& mesh = m_pMeshesRast.emplace_back(MeshRast{});
-	Utils::ParseOBJ("Resources/vehicle.obj", mesh.vertices, mesh.indices);
-	mesh.primitiveTopology = PrimitiveTopology::TriangleList;
 
+	//Render straight into the window surface when it's 32 bit without row padding,
+	//so presenting is just SDL_UpdateWindowSurface. Otherwise fall back to a back buffer and a blit
+	const bool canWriteFrontBuffer{ m_pFrontBuffer->format->BytesPerPixel == 4 && m_pFrontBuffer->pitch == m_Width * 4 };
+	if (canWriteFrontBuffer)
+	{
+		m_pRenderTarget = m_pFrontBuffer;
+	}
+	else
+	{
+		m_pBackBuffer = SDL_CreateRGBSurface(0, m_Width, m_Height, 32, 0, 0, 0, 0);
+		m_pRenderTarget = m_pBackBuffer;
+	}
+	if (!InitializeSoftware("Resources/vehicle.obj"))
+		std::cout << SDL_GetError() << '\n';
 
 	using namespace std;
 	{
-		SetConsoleTextAttribute(m_hConsole, m_YellowText);
+		SetTextColor(m_YellowText);
 		cout << "[Key bindings - SHARED]\n";
 		cout << "    [F1]  Toggle Rasterizer Mode (HARDWARE/SOFTWARE)\n";
 		cout << "    [F2]  Toggle Vehicle Rotation (ON/OFF)\n";
+		cout << "    [F4]  Cycle Sampler State (POINT/LINEAR/ANISOTROPIC)\n";
 		cout << "    [F9]  Cycle CullMode (BACK/FRONT/NONE)\n";
 		cout << "    [F10] Toggle Uniform ClearColor (ON/OFF)\n";
 		cout << "    [F11] Toggle Print FPS (ON/OFF)\n";
 		cout << '\n';
-		SetConsoleTextAttribute(m_hConsole, m_GreenText);
+		SetTextColor(m_GreenText);
 		cout << "[Key bindings - HARDWARE]\n";
 		cout << "    [F3]  Toggle FireFX (ON/OFF)\n";
-		cout << "    [F4]  Cycle Sampler State (POINT/LINEAR/ANISOTROPIC)\n";
 		cout << '\n';
-		SetConsoleTextAttribute(m_hConsole, m_MagentaText);
+		SetTextColor(m_MagentaText);
 		cout << "[Key bindings - SOFTWARE]\n";
 		cout << "    [F5]  Cycle Shading Mode (COMBINED/OBSERVED_AREA/DIFFUSE/SPECULAR)\n";
 		cout << "    [F6]  Toggle NormalMap (ON/OFF)\n";
 		cout << "    [F7]  Toggle DepthBuffer Visualization (ON/OFF)\n";
 		cout << "    [F8]  Toggle BoundingBox Visualization (ON/OFF)\n";
+		cout << "    [F12] Toggle Visibility Buffer Shading (ON/OFF)\n";
 		cout << '\n';
-		SetConsoleTextAttribute(m_hConsole, m_WhiteText);
+		SetTextColor(m_WhiteText);
+	}
+}
+
+Renderer::Renderer(int width, int height, const SoftwareScene& scene) :
+	m_Width{ width },
+	m_Height{ height },
+	m_IsHeadless{ true },
+	m_UsingHardware{ false }
+{
+	//Initialize
+	m_Camera.Initialize(45.f, { 0.f, 0.f, 0.f }, float(m_Width) / m_Height);
+	m_Translation = { 0, 0, 50.f };
+	m_Angle = 0;
+
+	//No device, so only the software copies of the textures
+	m_pDiffuseTxt = Texture::LoadFromFile(scene.diffusePath);
+	m_pNormalTxt = Texture::LoadFromFile(scene.normalPath);
+	m_pSpecularTxt = Texture::LoadFromFile(scene.specularPath);
+	m_pGlossTxt = Texture::LoadFromFile(scene.glossPath);
+	//Stays uninitialized, the caller reports it (SDL_GetError has the reason) and the destructor only frees what was made
+	if (!m_pDiffuseTxt || !m_pNormalTxt || !m_pSpecularTxt || !m_pGlossTxt)
+		return;
+	m_pMaterialTxt = MaterialTexture::Create(m_pDiffuseTxt, m_pNormalTxt, m_pSpecularTxt, m_pGlossTxt);
+	if (!m_pMaterialTxt)
+	{
+		SDL_SetError("The diffuse, normal, specular and gloss maps need the same size");
+		return;
+	}
+	//The software shader only samples the packed copy
+	for (Texture* pTexture : { m_pDiffuseTxt, m_pNormalTxt, m_pSpecularTxt, m_pGlossTxt })
+	{
+		pTexture->ReleaseTexels();
+	}
+
+	//The frame stays in an owned surface, GetPixels hands it out
+	m_pBackBuffer = SDL_CreateRGBSurfaceWithFormat(0, m_Width, m_Height, 32, SDL_PIXELFORMAT_ARGB8888);
+	m_pRenderTarget = m_pBackBuffer;
+	if (!InitializeSoftware(scene.meshPath))
+		return;
+	m_IsInitialized = true;
+}
+
+bool Renderer::InitializeSoftware(const std::string& meshPath)
+{
+	m_UseAVX2Kernels = CpuHasAVX2();
+	m_pBackBufferPixels = (uint32_t*)m_pRenderTarget->pixels;
+
+	//Pixels are packed by hand in the render target's format instead of with SDL_MapRGB per pixel
+	m_RedShift = m_pRenderTarget->format->Rshift;
+	m_GreenShift = m_pRenderTarget->format->Gshift;
+	m_BlueShift = m_pRenderTarget->format->Bshift;
+	m_AlphaMask = m_pRenderTarget->format->Amask;
+
+	m_pDepthBufferPixels = new float[m_Width * m_Height];
+
+	m_NumBlocksX = (m_Width + m_CoarseBlockSize - 1) / m_CoarseBlockSize;
+	m_NumBlocksY = (m_Height + m_CoarseBlockSize - 1) / m_CoarseBlockSize;
+	m_pCoarseDepthPixels = new float[m_NumBlocksX * m_NumBlocksY];
+
+	m_pVisibilityBufferPixels = new uint32_t[m_Width * m_Height];
+
+	//Tiles
+	m_NumTilesX = (m_Width + m_TileSize - 1) / m_TileSize;
+	m_NumTilesY = (m_Height + m_TileSize - 1) / m_TileSize;
+	std::vector<TileRast> tiles(size_t(m_NumTilesX) * m_NumTilesY);
+	for (int ty{}; ty < m_NumTilesY; ++ty)
+	{
+		for (int tx{}; tx < m_NumTilesX; ++tx)
+		{
+			TileRast& tile{ tiles[tx + ty * m_NumTilesX] };
+			tile.minX = tx * m_TileSize;
+			tile.minY = ty * m_TileSize;
+			tile.maxX = std::min(tile.minX + m_TileSize, m_Width);
+			tile.maxY = std::min(tile.minY + m_TileSize, m_Height);
+		}
+	}
+	m_pThreadPool = new ThreadPool{};
+
+	//Every frame in flight gets its own copy of the per-frame state
+	m_FramesRast.resize(m_MaxFramePipelineDepth);
+	for (FrameRast& frame : m_FramesRast)
+	{
+		frame.tiles = tiles;
+	}
+	m_TileStats.resize(tiles.size());
+	m_pFrameThread = new WorkerThread{};
+
+	//Guard band in NDC: vertices inside it are rasterized without clipping and still fit the fixed point range
+	m_GuardBand = 2.f * g_GuardBandCoordinate / float(std::max(m_Width, m_Height)) - 1.f;
+
+	//Mesh
+	MeshRast& mesh = m_pMeshesRast.emplace_back(MeshRast{});
+	if (!Utils::ParseOBJ(meshPath, mesh.vertices, mesh.indices) || mesh.indices.empty())
+	{
+		//No mesh at all rather than one without vertex streams
+		m_pMeshesRast.pop_back();
+		SDL_SetError("Could not read the mesh %s", meshPath.c_str());
+		return false;
 	}
+	mesh.primitiveTopology = PrimitiveTopology::TriangleList;
+	//Until the first Update, headless there might never be one
+	mesh.worldMatrix = Matrix::CreateRotationY(m_Angle) * Matrix::CreateTranslation(m_Translation);
+	FillVertexStreams(mesh);
+	for (FrameRast& frame : m_FramesRast)
+	{
+		frame.vertices.resize(m_pMeshesRast.size());
+		ResizeTransformedStreams(frame.vertices.back(), mesh.vertices.size());
+	}
+
+	return true;
 }
 
 Renderer::~Renderer()
@@ -118,11 +462,19 @@ Renderer::~Renderer()
 
 
 	//RASTERIZER
+	//Waits for the frame that is still being prepared, it uses the thread pool
+	delete m_pFrameThread;
 	delete m_pDiffuseTxt;
 	delete m_pNormalTxt;
 	delete m_pSpecularTxt;
 	delete m_pGlossTxt;
+	delete m_pMaterialTxt;
 	delete[] m_pDepthBufferPixels;
+	if (m_pBackBuffer)
+		SDL_FreeSurface(m_pBackBuffer);
+	delete[] m_pCoarseDepthPixels;
+	delete[] m_pVisibilityBufferPixels;
+	delete m_pThreadPool;
 }
 
 HRESULT Renderer::InitializeDirectX()
@@ -302,21 +654,240 @@ void Renderer::RenderHardware() const
 
 void Renderer::RenderSoftware()
 {
-	SDL_LockSurface(m_pBackBuffer);
-	//Clear backBuffer
+	PROFILE_ZONE("Render software");
+
+	//Front end of this frame runs on the frame thread: vertex stage and binning into its own copy of the state
+	FrameRast& frame{ m_FramesRast[m_NumFramesSubmitted % m_MaxFramePipelineDepth] };
+
+	//Everything the frame thread needs is copied now, so input and toggles can change while it works
+	frame.viewProjection = m_Camera.viewMatrix * m_Camera.projectionMatrix;
+	frame.cameraOrigin = m_Camera.origin;
+	frame.worldMatrices.clear();
+	for (const auto& mesh : m_pMeshesRast)
+	{
+		frame.worldMatrices.push_back(mesh.worldMatrix);
+	}
+	frame.cullMode = m_CullMode;
+
+	//Clear color, the buffers themselves are cleared per tile
 	ColorRGB clearColor{ .39f, .39f, .39f };
 	if (m_UniformClearColor)
 		clearColor = { 0.1f, 0.1f, 0.1f };
 
-	clearColor *= 255.f;
-	uint32_t hexColor = 0xFF000000 | (uint32_t)clearColor.b << 8 | (uint32_t)clearColor.g << 16 | (uint32_t)clearColor.r;
-	SDL_FillRect(m_pBackBuffer, NULL, hexColor);
+	frame.clearColor = PackColor(clearColor);
 
-	std::fill_n(m_pDepthBufferPixels, m_Width * m_Height, FLT_MAX);
-	VertexTransformationFunctionW4(m_pMeshesRast);
+	m_FrameTickets[m_NumFramesSubmitted % m_MaxFramePipelineDepth] = m_pFrameThread->Submit([this, &frame]()
+		{
+			PROFILE_ZONE("Frame front end");
+			TransformVertices(frame);
+			BinTriangles(frame);
+		});
+	++m_NumFramesSubmitted;
+
+	//Back end of the oldest frame(s), while the frame thread works on the newer ones
+	while (m_NumFramesSubmitted - m_NumFramesPresented >= m_FramePipelineDepth)
+	{
+		PresentSoftwareFrame();
+	}
+}
 
-	for (const auto& mesh : m_pMeshesRast)
+void Renderer::PresentSoftwareFrame()
+{
+	const uint32_t slot{ uint32_t(m_NumFramesPresented % m_MaxFramePipelineDepth) };
+	{
+		PROFILE_ZONE("Wait for frame front end");
+		m_pFrameThread->Wait(m_FrameTickets[slot]);
+	}
+	const FrameRast& frame{ m_FramesRast[slot] };
+
+	SDL_LockSurface(m_pRenderTarget);
+	//The window surface may have moved its pixels
+	m_pBackBufferPixels = (uint32_t*)m_pRenderTarget->pixels;
+
+	//Sort-middle: every triangle is binned into the tiles it touches, the tiles are rasterized in parallel.
+	//Tiles never share pixels, so the color and depth buffers need no locking, neither do the per tile counters.
+	{
+		PROFILE_ZONE("Rasterization");
+		std::fill(m_TileStats.begin(), m_TileStats.end(), RasterizerStats{});
+		m_pThreadPool->ParallelFor(uint32_t(frame.tiles.size()), [this, &frame](uint32_t tileIndex)
+			{
+				RasterizeTile(frame, frame.tiles[tileIndex], m_TileStats[tileIndex]);
+			});
+	}
+
+	m_FrameStats = frame.stats;
+	for (const RasterizerStats& tileStats : m_TileStats)
 	{
+		m_FrameStats += tileStats;
+	}
+
+	SDL_UnlockSurface(m_pRenderTarget);
+
+	if (m_PresentCallback)
+	{
+		PROFILE_ZONE("Present callback");
+		m_PresentCallback(m_pBackBufferPixels);
+	}
+
+	//Headless the frame just stays in the back buffer
+	if (!m_IsHeadless)
+	{
+		PROFILE_ZONE("Blit and present");
+		if (m_pBackBuffer)
+			SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
+		SDL_UpdateWindowSurface(m_pWindow);
+	}
+
+	++m_NumFramesPresented;
+}
+
+void Renderer::FlushSoftwareFrames()
+{
+	while (m_NumFramesPresented < m_NumFramesSubmitted)
+	{
+		PresentSoftwareFrame();
+	}
+}
+
+void Renderer::SetCameraPose(const Vector3& origin, float pitch, float yaw)
+{
+	m_Camera.SetPose(origin, pitch, yaw);
+}
+
+void Renderer::SetRotationAngle(float angle)
+{
+	m_Angle = angle;
+	UpdateSoftware(nullptr);
+}
+
+void Renderer::SetPresentCallback(const std::function<void(const uint32_t*)>& callback)
+{
+	FlushSoftwareFrames();
+	m_PresentCallback = callback;
+}
+
+const uint32_t* Renderer::GetPixels()
+{
+	FlushSoftwareFrames();
+	return m_pBackBufferPixels;
+}
+
+void Renderer::SetFramePipelineDepth(uint32_t depth)
+{
+	//Frames already in flight are finished first, they were submitted for the old depth
+	FlushSoftwareFrames();
+	m_FramePipelineDepth = std::clamp(depth, 1u, m_MaxFramePipelineDepth);
+}
+
+void Renderer::SetAVX2KernelsEnabled(bool enabled)
+{
+	//The frame thread might be in the vertex stage of a frame in flight
+	FlushSoftwareFrames();
+	m_UseAVX2Kernels = enabled && CpuHasAVX2();
+}
+
+uint32_t Renderer::GetNumRasterizerThreads() const
+{
+	return m_pThreadPool->GetNumThreads();
+}
+
+bool Renderer::SetupTriangle(TriangleRast& triangle, CullMode cullMode, RasterizerStats& stats) const
+{
+	Vertex_Out& A{ triangle.A };
+	Vertex_Out& B{ triangle.B };
+	Vertex_Out& C{ triangle.C };
+
+	//Snap to 16.8 fixed point, the float positions are moved onto the same grid so both edge versions agree
+	int64_t fixedAX{ llround(A.position.x * g_SubPixelScale) };
+	int64_t fixedAY{ llround(A.position.y * g_SubPixelScale) };
+	int64_t fixedBX{ llround(B.position.x * g_SubPixelScale) };
+	int64_t fixedBY{ llround(B.position.y * g_SubPixelScale) };
+	int64_t fixedCX{ llround(C.position.x * g_SubPixelScale) };
+	int64_t fixedCY{ llround(C.position.y * g_SubPixelScale) };
+
+	//Signed area in screen space (y down): positive is clockwise, which is front facing like the D3D path
+	int64_t fixedArea{ (fixedBX - fixedAX) * (fixedCY - fixedAY) - (fixedBY - fixedAY) * (fixedCX - fixedAX) };
+	if (fixedArea == 0) //degenerate
+	{
+		++stats.trianglesDegenerate;
+		return false;
+	}
+
+	const bool isFrontFacing{ fixedArea > 0 };
+	if ((isFrontFacing && cullMode == CullMode::Front) ||
+		(!isFrontFacing && cullMode == CullMode::Back))
+	{
+		++stats.trianglesBackfaceCulled;
+		return false;
+	}
+
+	//Back faces that survive get flipped so the rest of the pipeline only sees one winding
+	if (!isFrontFacing)
+	{
+		std::swap(B, C);
+		std::swap(fixedBX, fixedCX);
+		std::swap(fixedBY, fixedCY);
+		fixedArea = -fixedArea;
+	}
+
+	A.position.x = float(fixedAX) / g_SubPixelScale;
+	A.position.y = float(fixedAY) / g_SubPixelScale;
+	B.position.x = float(fixedBX) / g_SubPixelScale;
+	B.position.y = float(fixedBY) / g_SubPixelScale;
+	C.position.x = float(fixedCX) / g_SubPixelScale;
+	C.position.y = float(fixedCY) / g_SubPixelScale;
+
+	//Bounding box of the pixel centers inside the triangle's extents, empty means the triangle can't cover a sample
+	const int64_t halfPixel{ g_SubPixelScale / 2 };
+	const int64_t minFixedX{ std::min({ fixedAX, fixedBX, fixedCX }) - halfPixel };
+	const int64_t minFixedY{ std::min({ fixedAY, fixedBY, fixedCY }) - halfPixel };
+	const int64_t maxFixedX{ std::max({ fixedAX, fixedBX, fixedCX }) - halfPixel };
+	const int64_t maxFixedY{ std::max({ fixedAY, fixedBY, fixedCY }) - halfPixel };
+
+	triangle.minX = int(std::max<int64_t>((minFixedX + g_SubPixelScale - 1) >> g_SubPixelBits, 0));
+	triangle.minY = int(std::max<int64_t>((minFixedY + g_SubPixelScale - 1) >> g_SubPixelBits, 0));
+	triangle.maxX = int(std::min<int64_t>((maxFixedX >> g_SubPixelBits) + 1, m_Width));
+	triangle.maxY = int(std::min<int64_t>((maxFixedY >> g_SubPixelBits) + 1, m_Height));
+
+	if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY)
+	{
+		++stats.trianglesDegenerate;
+		return false;
+	}
+
+	//Per triangle constants: edge functions, reciprocals and the nearest depth for the Hi-Z test
+	triangle.fixedBC = MakeEdgeFunctionFixed(fixedBX, fixedBY, fixedCX, fixedCY);
+	triangle.fixedCA = MakeEdgeFunctionFixed(fixedCX, fixedCY, fixedAX, fixedAY);
+	triangle.fixedAB = MakeEdgeFunctionFixed(fixedAX, fixedAY, fixedBX, fixedBY);
+
+	const float invArea{ float(g_SubPixelScale * g_SubPixelScale) / float(fixedArea) };
+	triangle.edgeBC = MakeEdgeFunction(B.position, C.position, invArea);
+	triangle.edgeCA = MakeEdgeFunction(C.position, A.position, invArea);
+	triangle.edgeAB = MakeEdgeFunction(A.position, B.position, invArea);
+	triangle.invZ = { 1.f / A.position.z, 1.f / B.position.z, 1.f / C.position.z };
+	triangle.minZ = std::min(A.position.z, std::min(B.position.z, C.position.z));
+	triangle.invW = { 1.f / A.position.w, 1.f / B.position.w, 1.f / C.position.w };
+	triangle.invWdx = { triangle.edgeBC.a * triangle.invW.x, triangle.edgeCA.a * triangle.invW.y, triangle.edgeAB.a * triangle.invW.z };
+	triangle.invWdy = { triangle.edgeBC.b * triangle.invW.x, triangle.edgeCA.b * triangle.invW.y, triangle.edgeAB.b * triangle.invW.z };
+
+	return true;
+}
+
+void Renderer::BinTriangles(FrameRast& frame) const
+{
+	PROFILE_ZONE("Triangle setup and binning");
+
+	frame.triangles.clear();
+	frame.stats = {};
+	for (auto& tile : frame.tiles)
+	{
+		tile.triangleIndices.clear();
+	}
+
+	for (size_t meshIndex{}; meshIndex < m_pMeshesRast.size(); ++meshIndex)
+	{
+		const MeshRast& mesh{ m_pMeshesRast[meshIndex] };
+		const TransformedVertexStreams& streams{ frame.vertices[meshIndex] };
 		int incrementAmount{ 1 };
 		if (mesh.primitiveTopology == PrimitiveTopology::TriangleList)
 		{
@@ -329,6 +900,7 @@ void Renderer::RenderSoftware()
 			const uint32_t indexA{ mesh.indices[i] };
 			uint32_t indexB{ mesh.indices[i + 1] };
 			uint32_t indexC{ mesh.indices[i + 2] };
+			++frame.stats.trianglesSubmitted;
 
 			if (mesh.primitiveTopology == PrimitiveTopology::TriangleStrip)
 			{
@@ -337,257 +909,479 @@ void Renderer::RenderSoftware()
 					std::swap(indexB, indexC);
 				}
 
-				if (indexA == indexB)
-					continue;
-
-				if (indexB == indexC)
-					continue;
-
-				if (indexC == indexA)
+				if (indexA == indexB || indexB == indexC || indexC == indexA)
+				{
+					++frame.stats.trianglesDegenerate;
 					continue;
+				}
 			}
 
-			Vertex_Out A{ mesh.vertices_out[indexA] };
-			Vertex_Out B{ mesh.vertices_out[indexB] };
-			Vertex_Out C{ mesh.vertices_out[indexC] };
+			const uint32_t codeA{ streams.clipCodes[indexA] };
+			const uint32_t codeB{ streams.clipCodes[indexB] };
+			const uint32_t codeC{ streams.clipCodes[indexC] };
 
-			// Do frustum culling
-			if ((A.position.x < -1.0f || A.position.x > 1.0f) &&
-				(B.position.x < -1.0f || B.position.x > 1.0f) &&
-				(C.position.x < -1.0f || C.position.x > 1.0f))
+			// Do frustum culling, a triangle is only gone if all vertices are outside the same plane
+			if (codeA & codeB & codeC & g_FrustumCodeMask)
+			{
+				++frame.stats.trianglesFrustumCulled;
 				continue;
+			}
 
-			if ((A.position.y < -1.0f || A.position.y > 1.0f) &&
-				(B.position.y < -1.0f || B.position.y > 1.0f) &&
-				(C.position.y < -1.0f || C.position.y > 1.0f))
+			//Only triangles crossing the near/far plane or leaving the guard band get clipped,
+			//everything else outside the screen is handled by clamping the bounding box
+			const uint32_t clipCode{ (codeA | codeB | codeC) >> g_GuardBandCodeShift };
+			if (clipCode == 0)
+			{
+				BinTriangle(frame, GatherScreenVertex(mesh, streams, indexA), GatherScreenVertex(mesh, streams, indexB), GatherScreenVertex(mesh, streams, indexC));
 				continue;
+			}
+
+			std::array<Vertex_Out, g_MaxClippedVertices> polygon{ GatherVertex(mesh, streams, indexA), GatherVertex(mesh, streams, indexB), GatherVertex(mesh, streams, indexC) };
+			std::array<Vertex_Out, g_MaxClippedVertices> clipped{};
+			int count{ 3 };
+			++frame.stats.trianglesClipped;
+			for (uint32_t plane : g_ClipPlanes)
+			{
+				if ((clipCode & plane) == 0)
+					continue;
+
+				count = ClipPolygon(polygon.data(), count, clipped.data(), plane, m_GuardBand);
+				std::swap(polygon, clipped);
+				if (count < 3)
+					break;
+			}
 
-			if (A.position.z < 0.0f || A.position.z > 1.0f ||
-				B.position.z < 0.0f || B.position.z > 1.0f ||
-				C.position.z < 0.0f || C.position.z > 1.0f)
+			if (count < 3)
+			{
+				++frame.stats.trianglesFrustumCulled;
 				continue;
+			}
 
-			// Convert from NDC to ScreenSpace
-			A.position.x = (A.position.x + 1) / 2.0f * m_Width;
-			A.position.y = (1 - A.position.y) / 2.0f * m_Height;
-			B.position.x = (B.position.x + 1) / 2.0f * m_Width;
-			B.position.y = (1 - B.position.y) / 2.0f * m_Height;
-			C.position.x = (C.position.x + 1) / 2.0f * m_Width;
-			C.position.y = (1 - C.position.y) / 2.0f * m_Height;
-
-			float topLeftX = std::min(A.position.x, std::min(B.position.x, C.position.x));
-			float topLeftY = std::max(A.position.y, std::max(B.position.y, C.position.y));
-			float bottomRightX = std::max(A.position.x, std::max(B.position.x, C.position.x));
-			float bottomRightY = std::min(A.position.y, std::min(B.position.y, C.position.y));
-
-			topLeftX = Clamp(topLeftX, 0.f, float(m_Width));
-			topLeftY = Clamp(topLeftY, 0.f, float(m_Height));
-			bottomRightX = Clamp(bottomRightX, 0.f, float(m_Width));
-			bottomRightY = Clamp(bottomRightY, 0.f, float(m_Height));
-
-			//RENDER LOGIC
-			for (int px{ int(topLeftX) }; px < bottomRightX; ++px)
+			for (int v{}; v < count; ++v)
 			{
-				for (int py{ int(bottomRightY) }; py < topLeftY; ++py)
-				{
-					if (m_BoundingBoxVisualization)
-					{
-						ColorRGB finalColor{ 1.f,1.f,1.f };
-						
-						m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-							static_cast<uint8_t>(finalColor.r * 255),
-							static_cast<uint8_t>(finalColor.g * 255),
-							static_cast<uint8_t>(finalColor.b * 255));
-
-						continue;
-					}
-
-					dae::Vector2 pixel{ float(px + 0.5f), float(py + 0.5f) };
-					ColorRGB finalColor{ 0.0f, 0.0f, 0.0f };
-
-
-
-					// Define the edges of the screen triangle
-					const dae::Vector2 AB{ A.position.GetXY(), B.position.GetXY() };
-					const dae::Vector2 BC{ B.position.GetXY(), C.position.GetXY() };
-					const dae::Vector2 CA{ C.position.GetXY(), A.position.GetXY() };
-
-					const float signedAreaAB{ dae::Vector2::Cross(AB, dae::Vector2{ A.position.GetXY(), pixel}) };
-					const float signedAreaBC{ dae::Vector2::Cross(BC, dae::Vector2{ B.position.GetXY(), pixel}) };
-					const float signedAreaCA{ dae::Vector2::Cross(CA, dae::Vector2{ C.position.GetXY(), pixel}) };
-					const float triangleArea = dae::Vector2::Cross(AB, -CA);
-
-					if (signedAreaAB >= 0 && signedAreaBC >= 0 && signedAreaCA >= 0)
-					{
-						const float wA{ signedAreaBC / triangleArea };
-						const float wB{ signedAreaCA / triangleArea };
-						const float wC{ signedAreaAB / triangleArea };
-
-						const float bufferValueZ{ 1 / ((1 / A.position.z) * wA + (1 / B.position.z) * wB + (1 / C.position.z) * wC) }; //interpolated depth (non linear)
-
-						if (bufferValueZ > m_pDepthBufferPixels[px + (py * m_Width)])
-							continue;
-
-						m_pDepthBufferPixels[px + (py * m_Width)] = bufferValueZ;
-
-						float interpolatedW{ 1 / ((1 / A.position.w) * wA + (1 / B.position.w) * wB + (1 / C.position.w) * wC) }; // interpolated depth (linear)
-
-						dae::Vector2 uvInterpolated{
-							(A.uv / A.position.w) * wA +
-							(B.uv / B.position.w) * wB +
-							(C.uv / C.position.w) * wC
-						};
-						uvInterpolated *= interpolatedW;
-
-						Vector3 normalInterpolated{
-							(A.normal / A.position.w) * wA +
-							(B.normal / B.position.w) * wB +
-							(C.normal / C.position.w) * wC
-						};
-						normalInterpolated *= interpolatedW;
-						normalInterpolated.Normalize();
-
-						Vector3 tangentInterpolated{
-							(A.tangent / A.position.w) * wA +
-							(B.tangent / B.position.w) * wB +
-							(C.tangent / C.position.w) * wC
-						};
-						tangentInterpolated *= interpolatedW;
-						tangentInterpolated.Normalize();
-
-						Vector3 viewDirectionInterpolated{
-							(A.viewDirection / A.position.w) * wA +
-							(B.viewDirection / B.position.w) * wB +
-							(C.viewDirection / C.position.w) * wC
-						};
-						viewDirectionInterpolated *= interpolatedW;
-						viewDirectionInterpolated.Normalize();
-
-						Vertex_Out vertexOut{};
-						vertexOut.uv = uvInterpolated;
-						vertexOut.normal = normalInterpolated;
-						vertexOut.tangent = tangentInterpolated;
-						vertexOut.viewDirection = viewDirectionInterpolated;
-
-
-						Vector3 A3{A.position.x, A.position.y, A.position.z};
-						Vector3 B3{ B.position.x, B.position.y, B.position.z };
-						Vector3 C3{ C.position.x, C.position.y, C.position.z };
-
-						dae::Vector2 A2{ A.position.x, A.position.y };
-						dae::Vector2 B2{ B.position.x, B.position.y };
-						dae::Vector2 C2{ C.position.x, C.position.y };
-
-						Vector3 interpolatedPos{
-							(A3 / A.position.w) * wA +
-							(B3 / B.position.w) * wB +
-							(C3 / C.position.w) * wC
-						};
-						interpolatedPos *= interpolatedW;
-						//interpolatedPos.Normalize();
-
-						Vector3 rayToCamera{ (interpolatedPos - m_Camera.origin).Normalized() };
-						rayToCamera = m_Camera.right;
-
-						if (Vector3::Dot(A.normal, rayToCamera) == 0)
-							continue;
-
-						if (Vector3::Dot(A.normal, rayToCamera) > 0.f &&
-							m_pMeshes[0]->GetCullMode() == Effect::CullMode::Back) continue;
-
-						if (Vector3::Dot(A.normal, rayToCamera) < 0.f &&
-							m_pMeshes[0]->GetCullMode() == Effect::CullMode::Front) continue;
+				ClipToScreen(polygon[v].position, float(m_Width), float(m_Height));
+			}
+
+			//The clipped polygon is convex, so a fan keeps the winding of the original triangle
+			for (int v{ 1 }; v < count - 1; ++v)
+			{
+				BinTriangle(frame, polygon[0], polygon[v], polygon[v + 1]);
+			}
+		}
+	}
+}
 
+void Renderer::BinTriangle(FrameRast& frame, const Vertex_Out& A, const Vertex_Out& B, const Vertex_Out& C) const
+{
+	TriangleRast triangle{ A, B, C };
+	if (!SetupTriangle(triangle, frame.cullMode, frame.stats))
+		return;
+	++frame.stats.trianglesBinned;
 
-
-						if (m_DepthBufferVisualization)
-						{
-							const float min{ 0.995f };
-							const float max{ 1.0f };
-							float depthColor = (Clamp(bufferValueZ, min, max) - min) * (1.0f / (max - min));
-							//float depthColor = Remap(Clamp(bufferValueZ, min, max), min, max);
-							finalColor = { depthColor, depthColor, depthColor };
-						}
-						else
-						{
-							finalColor = PixelShading(vertexOut);
-						}
-
-						
-						//Update Color in Buffer
-						finalColor.MaxToOne();
-
-
-						m_pBackBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBackBuffer->format,
-							static_cast<uint8_t>(finalColor.r * 255),
-							static_cast<uint8_t>(finalColor.g * 255),
-							static_cast<uint8_t>(finalColor.b * 255));
-
-					}
+	//Bin into every tile the bounding box overlaps
+	const uint32_t triangleIndex{ uint32_t(frame.triangles.size()) };
+	frame.triangles.emplace_back(triangle);
+
+	const int minTileX{ triangle.minX / m_TileSize };
+	const int minTileY{ triangle.minY / m_TileSize };
+	const int maxTileX{ (triangle.maxX - 1) / m_TileSize };
+	const int maxTileY{ (triangle.maxY - 1) / m_TileSize };
+	for (int ty{ minTileY }; ty <= maxTileY; ++ty)
+	{
+		for (int tx{ minTileX }; tx <= maxTileX; ++tx)
+		{
+			frame.tiles[tx + ty * m_NumTilesX].triangleIndices.push_back(triangleIndex);
+		}
+	}
+}
+
+void Renderer::RasterizeTile(const FrameRast& frame, const TileRast& tile, RasterizerStats& stats) const
+{
+	PROFILE_ZONE("Rasterize tile");
+
+	//Tiles are made of whole coarse depth blocks, so these are owned by this tile too
+	const int tileBlockX{ tile.minX / m_CoarseBlockSize };
+	const int tileBlockY{ tile.minY / m_CoarseBlockSize };
+	const int tileBlocksX{ (tile.maxX - tile.minX + m_CoarseBlockSize - 1) / m_CoarseBlockSize };
+	const int tileBlocksY{ (tile.maxY - tile.minY + m_CoarseBlockSize - 1) / m_CoarseBlockSize };
+
+	//Clear this tile's part of the buffers
+	{
+		PROFILE_ZONE("Clear tile");
+		for (int py{ tile.minY }; py < tile.maxY; ++py)
+		{
+			std::fill(m_pBackBufferPixels + tile.minX + py * m_Width, m_pBackBufferPixels + tile.maxX + py * m_Width, frame.clearColor);
+			std::fill(m_pDepthBufferPixels + tile.minX + py * m_Width, m_pDepthBufferPixels + tile.maxX + py * m_Width, FLT_MAX);
+			if (m_UsingVisibilityBuffer)
+				std::fill(m_pVisibilityBufferPixels + tile.minX + py * m_Width, m_pVisibilityBufferPixels + tile.maxX + py * m_Width, m_NoTriangle);
+		}
+
+		for (int by{ tileBlockY }; by < tileBlockY + tileBlocksY; ++by)
+		{
+			std::fill_n(m_pCoarseDepthPixels + tileBlockX + by * m_NumBlocksX, tileBlocksX, FLT_MAX);
+		}
+	}
+
+	for (const uint32_t triangleIndex : tile.triangleIndices)
+	{
+		const TriangleRast& triangle{ frame.triangles[triangleIndex] };
+
+		//Only the part of the bounding box inside this tile
+		const int minX{ std::max(triangle.minX, tile.minX) };
+		const int minY{ std::max(triangle.minY, tile.minY) };
+		const int maxX{ std::min(triangle.maxX, tile.maxX) };
+		const int maxY{ std::min(triangle.maxY, tile.maxY) };
+
+		if (m_BoundingBoxVisualization)
+		{
+			const uint32_t white{ PackColor({ 1.f, 1.f, 1.f }) };
+			for (int py{ minY }; py < maxY; ++py)
+			{
+				std::fill(m_pBackBufferPixels + minX + py * m_Width, m_pBackBufferPixels + maxX + py * m_Width, white);
+			}
+			continue;
+		}
+
+		//Hierarchical Z: skip the triangle when its closest point is behind every block it touches
+		const int minBlockX{ minX / m_CoarseBlockSize };
+		const int minBlockY{ minY / m_CoarseBlockSize };
+		const int maxBlockX{ (maxX - 1) / m_CoarseBlockSize };
+		const int maxBlockY{ (maxY - 1) / m_CoarseBlockSize };
+		bool isOccluded{ true };
+		for (int by{ minBlockY }; by <= maxBlockY && isOccluded; ++by)
+		{
+			for (int bx{ minBlockX }; bx <= maxBlockX; ++bx)
+			{
+				if (triangle.minZ <= m_pCoarseDepthPixels[bx + by * m_NumBlocksX])
+				{
+					isOccluded = false;
+					break;
 				}
 			}
 		}
+		if (isOccluded)
+		{
+			++stats.trianglesHiZCulled;
+			continue;
+		}
+
+		//One bit per coarse block of this tile that got a depth write
+		uint64_t dirtyBlocks{ m_UseAVX2Kernels ?
+			RasterizeTriangleAVX2(triangle, triangleIndex, tile, minX, minY, maxX, maxY, stats) :
+			RasterizeTriangle(triangle, triangleIndex, tile, minX, minY, maxX, maxY, stats) };
+
+		//Pull the farthest depth of the written blocks in again
+		while (dirtyBlocks != 0)
+		{
+			const int block{ std::countr_zero(dirtyBlocks) };
+			dirtyBlocks &= dirtyBlocks - 1;
+
+			UpdateCoarseDepth(tileBlockX + block % (m_TileSize / m_CoarseBlockSize), tileBlockY + block / (m_TileSize / m_CoarseBlockSize));
+		}
 	}
 
-	SDL_UnlockSurface(m_pBackBuffer);
-	SDL_BlitSurface(m_pBackBuffer, 0, m_pFrontBuffer, 0);
-	SDL_UpdateWindowSurface(m_pWindow);
+	if (m_UsingVisibilityBuffer)
+		ShadeTileDeferred(frame, tile, stats);
 }
 
+uint64_t Renderer::RasterizeTriangle(const TriangleRast& triangle, uint32_t triangleIndex, const TileRast& tile,
+	int minX, int minY, int maxX, int maxY, RasterizerStats& stats) const
+{
+	//Tiles are made of whole coarse depth blocks
+	const int tileBlockX{ tile.minX / m_CoarseBlockSize };
+	const int tileBlockY{ tile.minY / m_CoarseBlockSize };
+
+	//One bit per coarse block of this tile that got a depth write
+	uint64_t dirtyBlocks{};
+
+	//Edge values at the first pixel center, after that only the steps get added
+	const float startX{ minX + 0.5f };
+	const float startY{ minY + 0.5f };
+	float rowWA{ triangle.edgeBC.Evaluate(startX, startY) };
+	float rowWB{ triangle.edgeCA.Evaluate(startX, startY) };
+	float rowWC{ triangle.edgeAB.Evaluate(startX, startY) };
+
+	const int64_t fixedStartX{ (int64_t(minX) << g_SubPixelBits) + g_SubPixelScale / 2 };
+	const int64_t fixedStartY{ (int64_t(minY) << g_SubPixelBits) + g_SubPixelScale / 2 };
+	int64_t rowEA{ triangle.fixedBC.Evaluate(fixedStartX, fixedStartY) };
+	int64_t rowEB{ triangle.fixedCA.Evaluate(fixedStartX, fixedStartY) };
+	int64_t rowEC{ triangle.fixedAB.Evaluate(fixedStartX, fixedStartY) };
+	const int64_t stepXEA{ triangle.fixedBC.a << g_SubPixelBits };
+	const int64_t stepXEB{ triangle.fixedCA.a << g_SubPixelBits };
+	const int64_t stepXEC{ triangle.fixedAB.a << g_SubPixelBits };
+	const int64_t stepYEA{ triangle.fixedBC.b << g_SubPixelBits };
+	const int64_t stepYEB{ triangle.fixedCA.b << g_SubPixelBits };
+	const int64_t stepYEC{ triangle.fixedAB.b << g_SubPixelBits };
+
+	for (int py{ minY }; py < maxY; ++py,
+		rowWA += triangle.edgeBC.b, rowWB += triangle.edgeCA.b, rowWC += triangle.edgeAB.b,
+		rowEA += stepYEA, rowEB += stepYEB, rowEC += stepYEC)
+	{
+		float wA{ rowWA };
+		float wB{ rowWB };
+		float wC{ rowWC };
+		int64_t eA{ rowEA };
+		int64_t eB{ rowEB };
+		int64_t eC{ rowEC };
+		const int blockY{ py / m_CoarseBlockSize };
+		for (int px{ minX }; px < maxX; ++px,
+			wA += triangle.edgeBC.a, wB += triangle.edgeCA.a, wC += triangle.edgeAB.a,
+			eA += stepXEA, eB += stepXEB, eC += stepXEC)
+		{
+			//Covered when no edge value is negative
+			if ((eA | eB | eC) < 0)
+				continue;
+
+			const int blockX{ px / m_CoarseBlockSize };
+			if (triangle.minZ > m_pCoarseDepthPixels[blockX + blockY * m_NumBlocksX])
+				continue;
+
+			++stats.pixelsCovered;
+			const float bufferValueZ{ 1 / (triangle.invZ.x * wA + triangle.invZ.y * wB + triangle.invZ.z * wC) }; //interpolated depth (non linear)
+
+			if (bufferValueZ > m_pDepthBufferPixels[px + (py * m_Width)])
+			{
+				++stats.depthTestsFailed;
+				continue;
+			}
+
+			++stats.depthTestsPassed;
+			if (m_pDepthBufferPixels[px + (py * m_Width)] == FLT_MAX)
+				++stats.pixelsWritten;
+			m_pDepthBufferPixels[px + (py * m_Width)] = bufferValueZ;
+			dirtyBlocks |= uint64_t(1) << ((blockX - tileBlockX) + (blockY - tileBlockY) * (m_TileSize / m_CoarseBlockSize));
 
-void Renderer::VertexTransformationFunctionW4(std::vector<MeshRast>& meshes) const
+			//Deferred: only remember which triangle is visible, shading happens once per pixel after all triangles
+			if (m_UsingVisibilityBuffer)
+			{
+				m_pVisibilityBufferPixels[px + (py * m_Width)] = triangleIndex;
+				continue;
+			}
+
+			//Perspective correct weights
+			const float perspA{ wA * triangle.invW.x };
+			const float perspB{ wB * triangle.invW.y };
+			const float perspC{ wC * triangle.invW.z };
+			const float interpolatedW{ 1 / (perspA + perspB + perspC) }; // interpolated depth (linear)
+
+			ShadePixel(triangle, px, py, perspA * interpolatedW, perspB * interpolatedW, perspC * interpolatedW, bufferValueZ, stats);
+		}
+	}
+
+	return dirtyBlocks;
+}
+
+void Renderer::ShadeTileDeferred(const FrameRast& frame, const TileRast& tile, RasterizerStats& stats) const
 {
-	for (MeshRast& mesh : meshes)
+	PROFILE_ZONE("Pixel shading (deferred)");
+
+	for (int py{ tile.minY }; py < tile.maxY; ++py)
 	{
-		const Matrix matrix = mesh.worldMatrix * (m_Camera.viewMatrix * m_Camera.projectionMatrix);
+		for (int px{ tile.minX }; px < tile.maxX; ++px)
+		{
+			const uint32_t triangleIndex{ m_pVisibilityBufferPixels[px + (py * m_Width)] };
+			if (triangleIndex == m_NoTriangle)
+				continue;
+
+			//Rebuild the barycentrics of the visible triangle at this pixel center
+			const TriangleRast& triangle{ frame.triangles[triangleIndex] };
+			const float pixelX{ px + 0.5f };
+			const float pixelY{ py + 0.5f };
+			const float perspA{ triangle.edgeBC.Evaluate(pixelX, pixelY) * triangle.invW.x };
+			const float perspB{ triangle.edgeCA.Evaluate(pixelX, pixelY) * triangle.invW.y };
+			const float perspC{ triangle.edgeAB.Evaluate(pixelX, pixelY) * triangle.invW.z };
+			const float interpolatedW{ 1 / (perspA + perspB + perspC) };
+
+			ShadePixel(triangle, px, py, perspA * interpolatedW, perspB * interpolatedW, perspC * interpolatedW, m_pDepthBufferPixels[px + (py * m_Width)], stats);
+		}
+	}
+}
 
-		mesh.vertices_out.clear();
-		mesh.vertices_out.reserve(mesh.vertices.size());
-		for (const Vertex& vertex : mesh.vertices)
+void Renderer::UpdateCoarseDepth(int blockX, int blockY) const
+{
+	const int minX{ blockX * m_CoarseBlockSize };
+	const int minY{ blockY * m_CoarseBlockSize };
+	const int maxX{ std::min(minX + m_CoarseBlockSize, m_Width) };
+	const int maxY{ std::min(minY + m_CoarseBlockSize, m_Height) };
+
+	float farthestDepth{ 0.f };
+	for (int py{ minY }; py < maxY; ++py)
+	{
+		for (int px{ minX }; px < maxX; ++px)
 		{
-			//Projection stage
-			Vector4 projectionVertex = matrix.TransformPoint({ vertex.position, 1.0f });
+			farthestDepth = std::max(farthestDepth, m_pDepthBufferPixels[px + py * m_Width]);
+		}
+	}
+	m_pCoarseDepthPixels[blockX + blockY * m_NumBlocksX] = farthestDepth;
+}
 
-			//Conversion to NDC - Perspective Divide (perspective distortion)
-			projectionVertex.x /= projectionVertex.w;
-			projectionVertex.y /= projectionVertex.w;
-			projectionVertex.z /= projectionVertex.w;
+void Renderer::ShadePixel(const TriangleRast& triangle, int px, int py, float wA, float wB, float wC, float bufferValueZ, RasterizerStats& stats) const
+{
+	const Vertex_Out& A{ triangle.A };
+	const Vertex_Out& B{ triangle.B };
+	const Vertex_Out& C{ triangle.C };
 
-			//convert normal and tangent to worldspace, for rotation -> normalize them after
-			const Vector3 normal{ mesh.worldMatrix.TransformVector(vertex.normal).Normalized() };
-			const Vector3 tangent{ mesh.worldMatrix.TransformVector(vertex.tangent).Normalized() };
+	ColorRGB finalColor{ 0.0f, 0.0f, 0.0f };
+	if (m_DepthBufferVisualization)
+	{
+		const float min{ 0.995f };
+		const float max{ 1.0f };
+		float depthColor = (Clamp(bufferValueZ, min, max) - min) * (1.0f / (max - min));
+		//float depthColor = Remap(Clamp(bufferValueZ, min, max), min, max);
+		finalColor = { depthColor, depthColor, depthColor };
+	}
+	else
+	{
+		//Weights are already perspective correct
+		Vertex_Out vertexOut{};
+		vertexOut.uv = A.uv * wA + B.uv * wB + C.uv * wC;
+		vertexOut.normal = (A.normal * wA + B.normal * wB + C.normal * wC).Normalized();
+		vertexOut.tangent = (A.tangent * wA + B.tangent * wB + C.tangent * wC).Normalized();
+		vertexOut.viewDirection = (A.viewDirection * wA + B.viewDirection * wB + C.viewDirection * wC).Normalized();
+
+		//uv = sum(e * uv / w) / sum(e / w) with e linear in x and y, so its derivative is exact:
+		//duv/dx = sum(de/dx / w * (uv_i - uv)) / sum(e / w)
+		const float pixelX{ px + 0.5f };
+		const float pixelY{ py + 0.5f };
+		const float invDenominator{ 1.f / (triangle.edgeBC.Evaluate(pixelX, pixelY) * triangle.invW.x +
+			triangle.edgeCA.Evaluate(pixelX, pixelY) * triangle.invW.y +
+			triangle.edgeAB.Evaluate(pixelX, pixelY) * triangle.invW.z) };
+		const dae::Vector2 toA{ A.uv - vertexOut.uv };
+		const dae::Vector2 toB{ B.uv - vertexOut.uv };
+		const dae::Vector2 toC{ C.uv - vertexOut.uv };
+		const dae::Vector2 dUVdx{ (toA * triangle.invWdx.x + toB * triangle.invWdx.y + toC * triangle.invWdx.z) * invDenominator };
+		const dae::Vector2 dUVdy{ (toA * triangle.invWdy.x + toB * triangle.invWdy.y + toC * triangle.invWdy.z) * invDenominator };
+
+		int numTexelFetches{};
+		finalColor = PixelShading(vertexOut, dUVdx, dUVdy, numTexelFetches);
+		++stats.pixelShadingInvocations;
+		stats.textureSamples += numTexelFetches;
+	}
 
-			// Calculate vert world position, for viewDirection
-			const Vector3 vertPosition{ mesh.worldMatrix.TransformPoint(vertex.position) };
-			const Vector3 viewDir{ m_Camera.origin - vertPosition };
+	//Update Color in Buffer
+	finalColor.MaxToOne();
 
-			Vertex_Out vertexOut{ projectionVertex, {}, vertex.uv,
-				normal, tangent, viewDir };
+	m_pBackBufferPixels[px + (py * m_Width)] = PackColor(finalColor);
+}
+
+uint32_t Renderer::PackColor(const ColorRGB& color) const
+{
+	return static_cast<uint32_t>(static_cast<uint8_t>(color.r * 255)) << m_RedShift |
+		static_cast<uint32_t>(static_cast<uint8_t>(color.g * 255)) << m_GreenShift |
+		static_cast<uint32_t>(static_cast<uint8_t>(color.b * 255)) << m_BlueShift |
+		m_AlphaMask;
+}
 
-			mesh.vertices_out.emplace_back(vertexOut);
 
+void Renderer::TransformVertices(FrameRast& frame) const
+{
+	PROFILE_ZONE("Vertex transformation");
 
+	for (size_t meshIndex{}; meshIndex < m_pMeshesRast.size(); ++meshIndex)
+	{
+		const MeshRast& mesh{ m_pMeshesRast[meshIndex] };
+		const Matrix& world{ frame.worldMatrices[meshIndex] };
+		const Matrix worldViewProjection = world * frame.viewProjection;
+
+		const uint32_t numVertices{ uint32_t(mesh.vertices.size()) };
+		const uint32_t numChunks{ (numVertices + g_VertexChunkSize - 1) / g_VertexChunkSize };
+		m_pThreadPool->ParallelFor(numChunks, [&](uint32_t chunkIndex)
+			{
+				PROFILE_ZONE("Transform vertex chunk");
+				const uint32_t begin{ chunkIndex * g_VertexChunkSize };
+				TransformVertexRange(mesh, world, worldViewProjection, frame.cameraOrigin, frame.vertices[meshIndex],
+					begin, std::min(begin + g_VertexChunkSize, numVertices));
+			});
+	}
+}
+
+void Renderer::TransformVertexRange(const MeshRast& mesh, const Matrix& world, const Matrix& worldViewProjection, const Vector3& cameraOrigin,
+	TransformedVertexStreams& s, uint32_t begin, uint32_t end) const
+{
+	const VertexStreams& in{ mesh.streams };
+
+	//Viewport transform folded into the vertex stage: x_screen = x / w * halfWidth + halfWidth
+	const float halfWidth{ m_Width * 0.5f };
+	const float halfHeight{ m_Height * 0.5f };
+
+	uint32_t i{ m_UseAVX2Kernels ? TransformVertexRangeAVX2(mesh, world, worldViewProjection, cameraOrigin, s, begin, end) : begin };
+
+	//The last vertices (or all of them without AVX2) go through the batch transforms of Matrix,
+	//gathered from the streams in blocks so the matrices stay loaded over a whole block
+	constexpr uint32_t blockSize{ 64 };
+	Vector3 positions[blockSize];
+	Vector3 normals[blockSize];
+	Vector3 tangents[blockSize];
+	Vector3 worldPositions[blockSize];
+	Vector4 clips[blockSize];
+	while (i < end)
+	{
+		const uint32_t count{ std::min(blockSize, end - i) };
+		for (uint32_t j{}; j < count; ++j)
+		{
+			positions[j] = { in.positionX[i + j], in.positionY[i + j], in.positionZ[i + j] };
+			normals[j] = { in.normalX[i + j], in.normalY[i + j], in.normalZ[i + j] };
+			tangents[j] = { in.tangentX[i + j], in.tangentY[i + j], in.tangentZ[i + j] };
+		}
+
+		worldViewProjection.TransformPoints(std::span{ positions, count }, std::span{ clips, count });
+		world.TransformPoints(std::span{ positions, count }, std::span{ worldPositions, count });
+		world.TransformNormals(std::span{ normals, count }, std::span{ normals, count });
+		world.TransformNormals(std::span{ tangents, count }, std::span{ tangents, count });
+
+		for (uint32_t j{}; j < count; ++j, ++i)
+		{
+			const Vector4& clip{ clips[j] };
+			s.clipX[i] = clip.x;
+			s.clipY[i] = clip.y;
+			s.clipZ[i] = clip.z;
+			s.clipW[i] = clip.w;
+
+			const float invW{ 1.f / clip.w };
+			s.screenX[i] = clip.x * invW * halfWidth + halfWidth;
+			s.screenY[i] = halfHeight - clip.y * invW * halfHeight;
+			s.screenZ[i] = Clamp(clip.z * invW, g_MinClippedDepth, 1.f);
+
+			s.worldNormalX[i] = normals[j].x;
+			s.worldNormalY[i] = normals[j].y;
+			s.worldNormalZ[i] = normals[j].z;
+
+			s.worldTangentX[i] = tangents[j].x;
+			s.worldTangentY[i] = tangents[j].y;
+			s.worldTangentZ[i] = tangents[j].z;
+
+			const Vector3 viewDirection{ cameraOrigin - worldPositions[j] };
+			s.viewDirectionX[i] = viewDirection.x;
+			s.viewDirectionY[i] = viewDirection.y;
+			s.viewDirectionZ[i] = viewDirection.z;
 		}
 	}
+
+	//Clip codes once per vertex instead of once per triangle corner
+	for (i = begin; i < end; ++i)
+	{
+		const Vector4 clip{ s.clipX[i], s.clipY[i], s.clipZ[i], s.clipW[i] };
+		s.clipCodes[i] = uint16_t(ClipCode(clip, 1.f) | ClipCode(clip, m_GuardBand) << g_GuardBandCodeShift);
+	}
 }
 
-ColorRGB Renderer::PixelShading(const Vertex_Out& v) const
+ColorRGB Renderer::PixelShading(const Vertex_Out& v, const dae::Vector2& dUVdx, const dae::Vector2& dUVdy, int& numTexelFetches) const
 {
 	const Vector3 lightDirection{ .577f, -.577f, .577f };
 	const float lightIntensity{ 7.f };
 	ColorRGB finalColor{};
 
+	//All four maps in one fetch
+	const MaterialSample material{ m_pMaterialTxt->Sample(v.uv, dUVdx, dUVdy, numTexelFetches) };
+
 	//Base color
-	const ColorRGB diffuse{ m_pDiffuseTxt->Sample(v.uv) };
+	const ColorRGB diffuse{ material.diffuse };
 	const ColorRGB lambert{ (lightIntensity * diffuse) / PI };
 
 	//Normals
 	const Vector3 binormal{ Vector3::Cross(v.normal, v.tangent) };
 	const Matrix tangentSpaceAxis{ v.tangent, binormal, v.normal, Vector3::Zero };
-	Vector3 sampledNormal{ m_pNormalTxt->Sample(v.uv).r, m_pNormalTxt->Sample(v.uv).g, m_pNormalTxt->Sample(v.uv).b };
-	//sampledNormal /= 255.f; // [0, 255] -> [0,1] //doesnt work with this but is in ppt, already done in sample function
-	sampledNormal = 2.f * sampledNormal - Vector3{ 1.f, 1.f, 1.f }; // [0,1] -> [-1, 1]
-	const Vector3 normalTangentSpace{ tangentSpaceAxis.TransformVector(sampledNormal) };
+	const Vector3 normalTangentSpace{ tangentSpaceAxis.TransformVector(material.normal) }; //already in [-1, 1]
 
 	Vector3 normal{ v.normal };
 	if (m_UsingNormalMap) normal = normalTangentSpace;
@@ -598,14 +1392,14 @@ ColorRGB Renderer::PixelShading(const Vertex_Out& v) const
 		return {};
 
 	//Phong specular
-	const ColorRGB specular{ m_pSpecularTxt->Sample(v.uv) };
-	const ColorRGB gloss{ m_pGlossTxt->Sample(v.uv) };
+	const ColorRGB specular{ material.specular, material.specular, material.specular };
+	const float gloss{ material.gloss };
 	const float shininess{ 25.f };
 	const ColorRGB ambient{ .025f, .025f, .025f };
 
 	const Vector3 reflection{ lightDirection - (2.0f * Vector3::Dot(normal, lightDirection) * normal) };
 	float dotReflectionViewDir{ std::max(0.f, Vector3::Dot(reflection, v.viewDirection)) }; // so dot is never negative
-	const ColorRGB phong{ specular * powf(dotReflectionViewDir, gloss.r * shininess) }; //r, g, b are the same so we can just use r (greyscale map)
+	const ColorRGB phong{ specular * powf(dotReflectionViewDir, gloss * shininess) }; //gloss is a greyscale map, packed as one channel
 
 
 	switch (m_LightMode)
@@ -630,9 +1424,14 @@ ColorRGB Renderer::PixelShading(const Vertex_Out& v) const
 //SWITCH STATES
 void Renderer::SwitchState()
 {
+	if (m_IsHeadless)
+		return;
+
+	//Software frames still in flight get presented before the hardware path takes the window
+	FlushSoftwareFrames();
 	m_UsingHardware = !m_UsingHardware;
 
-	SetConsoleTextAttribute(m_hConsole, m_YellowText);
+	SetTextColor(m_YellowText);
 	if (m_UsingHardware)
 	{
 		std::cout << " Hardware\n";
@@ -641,14 +1440,17 @@ void Renderer::SwitchState()
 	{
 		std::cout << " Software\n";
 	}
-	SetConsoleTextAttribute(m_hConsole, m_WhiteText);
+	SetTextColor(m_WhiteText);
 }
 
 void Renderer::SwitchRotating()
 {
 	m_IsRotating = !m_IsRotating;
 
-	SetConsoleTextAttribute(m_hConsole, m_YellowText);
+	if (m_IsHeadless)
+		return;
+
+	SetTextColor(m_YellowText);
 	if (m_IsRotating)
 	{
 		std::cout << " Rotation Enabled\n";
@@ -657,7 +1459,7 @@ void Renderer::SwitchRotating()
 	{
 		std::cout << " Rotation Disabled\n";
 	}
-	SetConsoleTextAttribute(m_hConsole, m_WhiteText);
+	SetTextColor(m_WhiteText);
 
 }
 
@@ -668,7 +1470,7 @@ void Renderer::SwitchUsingFire()
 
 	m_UsingFireMesh = !m_UsingFireMesh;
 
-	SetConsoleTextAttribute(m_hConsole, m_GreenText);
+	SetTextColor(m_GreenText);
 	if (m_UsingFireMesh)
 	{
 		std::cout << " FireMesh Enabled\n";
@@ -677,35 +1479,63 @@ void Renderer::SwitchUsingFire()
 	{
 		std::cout << " FireMesh Disabled\n";
 	}
-	SetConsoleTextAttribute(m_hConsole, m_WhiteText);
+	SetTextColor(m_WhiteText);
 }
 
 void Renderer::SwitchTechniques() const
 {
-	if (!m_UsingHardware)
-		return;
-
 	for (auto& m : m_pMeshes)
 	{
 		m->ToggleTechniques();
 	}
 
-	SetConsoleTextAttribute(m_hConsole, m_GreenText);
-	switch (m_pMeshes[0]->GetSampleState())
+	//The software textures follow the hardware sampler state, headless they cycle on their own
+	Texture::Filter filter{ Texture::Filter::Point };
+	if (m_pMeshes.empty())
+	{
+		if (int(m_pMaterialTxt->GetFilter()) < 2) // < amount Filters - 1
+			filter = Texture::Filter(int(m_pMaterialTxt->GetFilter()) + 1);
+	}
+	else
 	{
-	case Effect::FilteringMethod::Point:
+		switch (m_pMeshes[0]->GetSampleState())
+		{
+		case Effect::FilteringMethod::Point:
+			filter = Texture::Filter::Point;
+			break;
+		case  Effect::FilteringMethod::Linear:
+			filter = Texture::Filter::Linear;
+			break;
+		case  Effect::FilteringMethod::Anisotropic:
+			filter = Texture::Filter::Anisotropic;
+			break;
+		default:
+			break;
+		}
+	}
+
+	m_pMaterialTxt->SetFilter(filter);
+
+	//Headless runs keep stdout for their own machine readable output
+	if (m_IsHeadless)
+		return;
+
+	SetTextColor(m_YellowText);
+	switch (filter)
+	{
+	case Texture::Filter::Point:
 		std::cout << " Point\n";
 		break;
-	case  Effect::FilteringMethod::Linear:
+	case Texture::Filter::Linear:
 		std::cout << " Linear\n";
 		break;
-	case  Effect::FilteringMethod::Anisotropic:
+	case Texture::Filter::Anisotropic:
 		std::cout << " Anisotropic\n";
 		break;
 	default:
 		break;
 	}
-	SetConsoleTextAttribute(m_hConsole, m_WhiteText);
+	SetTextColor(m_WhiteText);
 }
 
 void Renderer::SwitchShadingMode()
@@ -718,7 +1548,10 @@ void Renderer::SwitchShadingMode()
 	else
 		m_LightMode = LightMode(0);
 
-	SetConsoleTextAttribute(m_hConsole, m_MagentaText);
+	if (m_IsHeadless)
+		return;
+
+	SetTextColor(m_MagentaText);
 	switch (m_LightMode)
 	{
 	case Renderer::LightMode::Combined:
@@ -737,7 +1570,7 @@ void Renderer::SwitchShadingMode()
 		break;
 	}
 
-	SetConsoleTextAttribute(m_hConsole, m_WhiteText);
+	SetTextColor(m_WhiteText);
 }
 
 void Renderer::SwitchNormalMap()
@@ -747,7 +1580,10 @@ void Renderer::SwitchNormalMap()
 
 	m_UsingNormalMap = !m_UsingNormalMap;
 
-	SetConsoleTextAttribute(m_hConsole, m_MagentaText);
+	if (m_IsHeadless)
+		return;
+
+	SetTextColor(m_MagentaText);
 	if (m_UsingNormalMap)
 	{
 		std::cout << " Normals Enabled\n";
@@ -756,7 +1592,7 @@ void Renderer::SwitchNormalMap()
 	{
 		std::cout << " Normals Disabled\n";
 	}
-	SetConsoleTextAttribute(m_hConsole, m_WhiteText);
+	SetTextColor(m_WhiteText);
 }
 
 void Renderer::SwitchDepthBufferVisualization()
@@ -765,7 +1601,11 @@ void Renderer::SwitchDepthBufferVisualization()
 		return;
 
 	m_DepthBufferVisualization = !m_DepthBufferVisualization;
-	SetConsoleTextAttribute(m_hConsole, m_MagentaText);
+
+	if (m_IsHeadless)
+		return;
+
+	SetTextColor(m_MagentaText);
 	if (m_DepthBufferVisualization)
 	{
 		std::cout << " DepthBuffer Visualization Enabled\n";
@@ -774,7 +1614,7 @@ void Renderer::SwitchDepthBufferVisualization()
 	{
 		std::cout << " DepthBuffer Visualization Disabled\n";
 	}
-	SetConsoleTextAttribute(m_hConsole, m_WhiteText);
+	SetTextColor(m_WhiteText);
 }
 
 void Renderer::SwitchBoundingBoxVisualization()
@@ -784,7 +1624,10 @@ void Renderer::SwitchBoundingBoxVisualization()
 
 	m_BoundingBoxVisualization = !m_BoundingBoxVisualization;
 
-	SetConsoleTextAttribute(m_hConsole, m_MagentaText);
+	if (m_IsHeadless)
+		return;
+
+	SetTextColor(m_MagentaText);
 	if (m_BoundingBoxVisualization)
 	{
 		std::cout << " BoundingBox Visualization Enabled\n";
@@ -793,14 +1636,39 @@ void Renderer::SwitchBoundingBoxVisualization()
 	{
 		std::cout << " BoundingBox Visualization Disabled\n";
 	}
-	SetConsoleTextAttribute(m_hConsole, m_WhiteText);
+	SetTextColor(m_WhiteText);
+}
+
+void Renderer::SwitchVisibilityBufferShading()
+{
+	if (m_UsingHardware)
+		return;
+
+	m_UsingVisibilityBuffer = !m_UsingVisibilityBuffer;
+
+	if (m_IsHeadless)
+		return;
+
+	SetTextColor(m_MagentaText);
+	if (m_UsingVisibilityBuffer)
+	{
+		std::cout << " Visibility Buffer Shading Enabled\n";
+	}
+	else
+	{
+		std::cout << " Visibility Buffer Shading Disabled\n";
+	}
+	SetTextColor(m_WhiteText);
 }
 
 void Renderer::ToggleUniformClearColor()
 {
 	m_UniformClearColor = !m_UniformClearColor;
 
-	SetConsoleTextAttribute(m_hConsole, m_YellowText);
+	if (m_IsHeadless)
+		return;
+
+	SetTextColor(m_YellowText);
 	if (m_UniformClearColor)
 	{
 		std::cout << " Uniform ClearColor Enabled\n";
@@ -809,39 +1677,80 @@ void Renderer::ToggleUniformClearColor()
 	{
 		std::cout << " Uniform ClearColor Disabled\n";
 	}
-	SetConsoleTextAttribute(m_hConsole, m_WhiteText);
+	SetTextColor(m_WhiteText);
 }
 
 void Renderer::ToggleCullMode()
 {
-	m_pMeshes[0]->ToggleCullMode();
+	//Headless there is no effect to follow, the software copy cycles in the same order (NONE/FRONT/BACK)
+	if (m_pMeshes.empty())
+	{
+		if (int(m_CullMode) < 2) // < amount CullModes - 1
+			m_CullMode = CullMode(int(m_CullMode) + 1);
+		else
+			m_CullMode = CullMode(0);
+	}
+	else
+	{
+		m_pMeshes[0]->ToggleCullMode();
+		switch (m_pMeshes[0]->GetCullMode())
+		{
+		case Effect::CullMode::None:
+			m_CullMode = CullMode::None;
+			break;
+		case Effect::CullMode::Front:
+			m_CullMode = CullMode::Front;
+			break;
+		case Effect::CullMode::Back:
+			m_CullMode = CullMode::Back;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (m_IsHeadless)
+		return;
 
-	SetConsoleTextAttribute(m_hConsole, m_YellowText);
-	switch (m_pMeshes[0]->GetCullMode())
+	SetTextColor(m_YellowText);
+	switch (m_CullMode)
 	{
-	case Effect::CullMode::None:
+	case CullMode::None:
 		std::cout << " Cullmode set to None\n";
 		break;
-	case Effect::CullMode::Front:
+	case CullMode::Front:
 		std::cout << " Cullmode set to Front\n";
 		break;
-	case Effect::CullMode::Back:
+	case CullMode::Back:
 		std::cout << " Cullmode set to Back\n";
 		break;
 	default:
 		break;
 	}
 
-	SetConsoleTextAttribute(m_hConsole, m_WhiteText);
+	SetTextColor(m_WhiteText);
 }
 
 void Renderer::SwitchFPSPrinting(bool& printFPS)
 {
 	printFPS = !printFPS;
-	SetConsoleTextAttribute(m_hConsole, m_YellowText);
+
+	if (m_IsHeadless)
+		return;
+
+	SetTextColor(m_YellowText);
 	if (printFPS)
 		std::cout << " Print FPS ON\n";
 	else
 		std::cout << " Print FPS OFF\n";
-	SetConsoleTextAttribute(m_hConsole, m_WhiteText);
+	SetTextColor(m_WhiteText);
+}
+
+void Renderer::SetTextColor(int color) const
+{
+	//No console to color when running headless
+	if (m_IsHeadless)
+		return;
+
+	SetConsoleTextAttribute(m_hConsole, color);
 }
\ No newline at end of file
@@ -1,19 +1,39 @@
 #pragma once
+#include <functional>
+#include <string>
 #include "Camera.h"
+#include "RasterizerStats.h"
 
 struct SDL_Window;
 struct SDL_Surface;
 class MeshRepresentation;
 class Texture;
+class MaterialTexture;
 struct Vertex_Out;
 struct MeshRast;
+struct TriangleRast;
+struct TileRast;
+struct TransformedVertexStreams;
+namespace dae { class ThreadPool; class WorkerThread; class KernelBenchmarks; }
 
 using namespace dae;
 
+//Files the headless renderer loads, the defaults are the vehicle of the windowed renderer
+struct SoftwareScene
+{
+	std::string meshPath{ "Resources/vehicle.obj" };
+	std::string diffusePath{ "Resources/vehicle_diffuse.png" };
+	std::string normalPath{ "Resources/vehicle_normal.png" };
+	std::string specularPath{ "Resources/vehicle_specular.png" };
+	std::string glossPath{ "Resources/vehicle_gloss.png" };
+};
+
 	class Renderer final
 	{
 	public:
 		Renderer(SDL_Window* pWindow);
+		//Headless: software rasterizer only, renders into an owned framebuffer without a window, device or console output
+		Renderer(int width, int height, const SoftwareScene& scene = {});
 		~Renderer();
 
 		Renderer(const Renderer&) = delete;
@@ -24,6 +44,25 @@ using namespace dae;
 		void Update(const Timer* pTimer);
 		void Render();
 
+		//Pixels of the last software frame (frames in flight are finished first), width * height packed colors.
+		//Headless they are 0xAARRGGBB, with a window they are in the window surface's format
+		const uint32_t* GetPixels();
+		//Headless: false when the scene couldn't be loaded, nothing can be rendered then
+		bool IsInitialized() const { return m_IsInitialized; };
+		int GetWidth() const { return m_Width; };
+		int GetHeight() const { return m_Height; };
+
+		//Pitch and yaw in radians, replaces the camera input until the next Update
+		void SetCameraPose(const Vector3& origin, float pitch, float yaw);
+		//Vehicle rotation in radians, replaces the rotation until the next Update
+		void SetRotationAngle(float angle);
+		//Called on the main thread with the pixels (see GetPixels) of every software frame once it is rasterized,
+		//so frames can be read back without giving up the frame pipelining
+		void SetPresentCallback(const std::function<void(const uint32_t*)>& callback);
+		//Counters of the last software frame that was rasterized, in the present callback those of the frame being presented.
+		//With frame pipelining that is not the frame of the last Render call
+		const RasterizerStats& GetFrameStats() const { return m_FrameStats; };
+
 		//Switch States
 		void SwitchState();
 		void SwitchRotating();
@@ -33,11 +72,26 @@ using namespace dae;
 		void SwitchNormalMap();
 		void SwitchDepthBufferVisualization();
 		void SwitchBoundingBoxVisualization();
+		void SwitchVisibilityBufferShading();
 		void ToggleUniformClearColor();
 		void ToggleCullMode();
 		void SwitchFPSPrinting(bool& printFPS);
 
+		//Software frames in flight: 1 = no overlap, 2 = binning of the next frame overlaps rasterizing this one
+		void SetFramePipelineDepth(uint32_t depth);
+		uint32_t GetFramePipelineDepth() const { return m_FramePipelineDepth; };
+		//Rasterizes and presents every software frame that is still in flight
+		void FlushSoftwareFrames();
+		//The AVX2 kernels are used when the cpu has AVX2, FMA, POPCNT and BMI1, false forces the scalar ones everywhere (to test or compare them)
+		void SetAVX2KernelsEnabled(bool enabled);
+		bool AreAVX2KernelsEnabled() const { return m_UseAVX2Kernels; };
+		//Threads of the pool that bins, rasterizes and shades the tiles, including the calling thread
+		uint32_t GetNumRasterizerThreads() const;
+
 	private:
+		//Times PixelShading in every light mode
+		friend class dae::KernelBenchmarks;
+
 		//SHARED
 		SDL_Window* m_pWindow{};
 
@@ -45,6 +99,7 @@ using namespace dae;
 		int m_Height{};
 
 		bool m_IsInitialized{ false };
+		bool m_IsHeadless{ false };
 
 		Camera m_Camera{};
 		float m_Angle{};
@@ -52,31 +107,64 @@ using namespace dae;
 
 		//DIRECTX
 		HRESULT InitializeDirectX();
-		ID3D11Device* m_pDevice;
-		ID3D11DeviceContext* m_pDeviceContext;
-		IDXGISwapChain* m_pSwapChain;
-		ID3D11Texture2D* m_pDepthStencilBuffer;
-		ID3D11DepthStencilView* m_pDepthStencilView;
-		ID3D11Resource* m_pRenderTargetBuffer;
-		ID3D11RenderTargetView* m_pRenderTargetView;
+		ID3D11Device* m_pDevice{ nullptr };
+		ID3D11DeviceContext* m_pDeviceContext{ nullptr };
+		IDXGISwapChain* m_pSwapChain{ nullptr };
+		ID3D11Texture2D* m_pDepthStencilBuffer{ nullptr };
+		ID3D11DepthStencilView* m_pDepthStencilView{ nullptr };
+		ID3D11Resource* m_pRenderTargetBuffer{ nullptr };
+		ID3D11RenderTargetView* m_pRenderTargetView{ nullptr };
 		std::vector<MeshRepresentation*> m_pMeshes;
-		MeshRepresentation* m_pFireMesh;
+		MeshRepresentation* m_pFireMesh{ nullptr };
 
 		void RenderHardware() const;
 		void UpdateHardware(const Timer* pTimer);
 
 		//Rasterizer
+		//False (and the reason in SDL_GetError) when the mesh can't be read, the rasterizer then has nothing to draw
+		bool InitializeSoftware(const std::string& meshPath);
+		void SetTextColor(int color) const;
 		SDL_Surface* m_pFrontBuffer{ nullptr };
+		//Only created when the window surface can't be written directly
 		SDL_Surface* m_pBackBuffer{ nullptr };
+		//The surface the rasterizer writes to, the front buffer or the back buffer
+		SDL_Surface* m_pRenderTarget{ nullptr };
 		uint32_t* m_pBackBufferPixels{ nullptr };
+		uint32_t m_RedShift{};
+		uint32_t m_GreenShift{};
+		uint32_t m_BlueShift{};
+		uint32_t m_AlphaMask{};
 		std::vector<MeshRast> m_pMeshesRast;
 
 		float* m_pDepthBufferPixels{};
 
-		Texture* m_pDiffuseTxt;
-		Texture* m_pNormalTxt;
-		Texture* m_pSpecularTxt;
-		Texture* m_pGlossTxt;
+		//Hierarchical Z: farthest depth of every 8x8 block, to reject triangles and blocks before any per-pixel work
+		static constexpr int m_CoarseBlockSize{ 8 };
+		int m_NumBlocksX{};
+		int m_NumBlocksY{};
+		float* m_pCoarseDepthPixels{};
+
+		//Visibility buffer: index of the visible triangle per pixel, shaded in a second pass
+		static constexpr uint32_t m_NoTriangle{ UINT32_MAX };
+		uint32_t* m_pVisibilityBufferPixels{};
+
+		//Binning (sort-middle): triangles are set up once, then every tile is rasterized on its own by the thread pool
+		static constexpr int m_TileSize{ 64 };
+		static_assert(m_TileSize % m_CoarseBlockSize == 0 && (m_TileSize / m_CoarseBlockSize) * (m_TileSize / m_CoarseBlockSize) <= 64,
+			"A tile has to be made of at most 64 whole coarse depth blocks");
+		int m_NumTilesX{};
+		int m_NumTilesY{};
+		ThreadPool* m_pThreadPool{ nullptr };
+		float m_GuardBand{ 1.f };
+		//Picked once from the cpu, RendererAVX2.cpp is the only file built with AVX2
+		bool m_UseAVX2Kernels{ false };
+
+		Texture* m_pDiffuseTxt{ nullptr };
+		Texture* m_pNormalTxt{ nullptr };
+		Texture* m_pSpecularTxt{ nullptr };
+		Texture* m_pGlossTxt{ nullptr };
+		//The four maps above interleaved, what the software shader samples
+		MaterialTexture* m_pMaterialTxt{ nullptr };
 
 		enum class LightMode
 		{
@@ -87,11 +175,68 @@ using namespace dae;
 		};
 		LightMode m_LightMode{ LightMode::Combined };
 
+		//Software copy of the cull mode, so the rasterizer doesn't have to ask the effect for it
+		enum class CullMode
+		{
+			None,
+			Front,
+			Back
+		};
+		CullMode m_CullMode{ CullMode::None };
+
+		//Everything one software frame needs after Render returned, so the next frame can be prepared while this one is rasterized
+		struct FrameRast
+		{
+			Matrix viewProjection{};
+			Vector3 cameraOrigin{};
+			std::vector<Matrix> worldMatrices{};
+			CullMode cullMode{ CullMode::None };
+			uint32_t clearColor{};
+			//Front end counters, the back end ones are added when the frame is rasterized
+			RasterizerStats stats{};
+
+			std::vector<TransformedVertexStreams> vertices{};
+			std::vector<TriangleRast> triangles{};
+			std::vector<TileRast> tiles{};
+		};
+
+		//Frame pipelining: vertex stage and binning run on the frame thread, rasterizing and presenting on the main thread
+		static constexpr uint32_t m_MaxFramePipelineDepth{ 3 };
+		uint32_t m_FramePipelineDepth{ 2 };
+		std::vector<FrameRast> m_FramesRast;
+		uint64_t m_FrameTickets[m_MaxFramePipelineDepth]{};
+		uint64_t m_NumFramesSubmitted{};
+		uint64_t m_NumFramesPresented{};
+		WorkerThread* m_pFrameThread{ nullptr };
+		std::function<void(const uint32_t*)> m_PresentCallback{};
+		std::vector<RasterizerStats> m_TileStats;
+		RasterizerStats m_FrameStats{};
+
 		void RenderSoftware(); 
+		void PresentSoftwareFrame();
 		void UpdateSoftware(const Timer* pTimer);
+		bool SetupTriangle(TriangleRast& triangle, CullMode cullMode, RasterizerStats& stats) const;
+		void BinTriangles(FrameRast& frame) const;
+		void BinTriangle(FrameRast& frame, const Vertex_Out& A, const Vertex_Out& B, const Vertex_Out& C) const;
+		void RasterizeTile(const FrameRast& frame, const TileRast& tile, RasterizerStats& stats) const;
+		//Rasterizes the part of a triangle inside minX..maxX/minY..maxY of the tile, returns the coarse blocks it wrote depth to
+		uint64_t RasterizeTriangle(const TriangleRast& triangle, uint32_t triangleIndex, const TileRast& tile,
+			int minX, int minY, int maxX, int maxY, RasterizerStats& stats) const;
+		uint64_t RasterizeTriangleAVX2(const TriangleRast& triangle, uint32_t triangleIndex, const TileRast& tile,
+			int minX, int minY, int maxX, int maxY, RasterizerStats& stats) const;
+		void UpdateCoarseDepth(int blockX, int blockY) const;
+		void ShadeTileDeferred(const FrameRast& frame, const TileRast& tile, RasterizerStats& stats) const;
+		void ShadePixel(const TriangleRast& triangle, int px, int py, float wA, float wB, float wC, float bufferValueZ, RasterizerStats& stats) const;
 
-		ColorRGB PixelShading(const Vertex_Out& v) const;
-		void VertexTransformationFunctionW4(std::vector<MeshRast>& meshes) const;
+		uint32_t PackColor(const ColorRGB& color) const;
+		//numTexelFetches gets the texels the material filter read added
+		ColorRGB PixelShading(const Vertex_Out& v, const dae::Vector2& dUVdx, const dae::Vector2& dUVdy, int& numTexelFetches) const;
+		void TransformVertices(FrameRast& frame) const;
+		void TransformVertexRange(const MeshRast& mesh, const Matrix& world, const Matrix& worldViewProjection, const Vector3& cameraOrigin,
+			TransformedVertexStreams& s, uint32_t begin, uint32_t end) const;
+		//8 vertices at a time, returns the first vertex it left for the scalar code
+		uint32_t TransformVertexRangeAVX2(const MeshRast& mesh, const Matrix& world, const Matrix& worldViewProjection, const Vector3& cameraOrigin,
+			TransformedVertexStreams& s, uint32_t begin, uint32_t end) const;
 
 		//Switch States
 		bool m_UsingHardware = true;
@@ -100,6 +245,7 @@ using namespace dae;
 		bool m_UsingNormalMap = true;
 		bool m_DepthBufferVisualization = false;
 		bool m_BoundingBoxVisualization = false;
+		bool m_UsingVisibilityBuffer = false;
 		bool m_UniformClearColor = false;
 
 		//TextColors
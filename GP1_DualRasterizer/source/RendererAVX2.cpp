@@ -0,0 +1,298 @@
+//The AVX2 (and FMA, POPCNT, BMI1) kernels of the software rasterizer, written with intrinsics only.
+//Not built with /arch:AVX2: the linker keeps one copy of every inline function (vectors, matrix, STL) for the whole
+//binary and could pick a VEX encoded one from here, which would then run in the scalar path on cpus without AVX2.
+//So this file calls no shared inline helpers in its kernels, and the renderer only calls into it after checking the cpu,
+//see CpuHasAVX2 in Renderer.cpp
+#include "pch.h"
+#include "Renderer.h"
+#include "MeshRepresentation.h"
+#include <immintrin.h>
+#include <intrin.h>
+
+//Matrix elements broadcast over 8 lanes, elements[row * 4 + column]
+struct MatrixLanes
+{
+	__m256 elements[16];
+};
+
+static MatrixLanes BroadcastMatrix(const Matrix& matrix)
+{
+	//Read as 16 floats, row by row, instead of through Matrix::operator[]
+	static_assert(sizeof(Matrix) == 16 * sizeof(float), "Matrix has to be its 4 rows only");
+	const float* pElements{ reinterpret_cast<const float*>(&matrix) };
+
+	MatrixLanes lanes{};
+	for (int element{}; element < 16; ++element)
+	{
+		lanes.elements[element] = _mm256_set1_ps(pElements[element]);
+	}
+	return lanes;
+}
+
+//One component of 8 row vectors times the matrix, points also get the translation row
+static __m256 TransformLanes(const MatrixLanes& lanes, int column, __m256 x, __m256 y, __m256 z, bool isPoint)
+{
+	__m256 result{ _mm256_add_ps(_mm256_mul_ps(x, lanes.elements[column]), _mm256_mul_ps(y, lanes.elements[4 + column])) };
+	result = _mm256_add_ps(result, _mm256_mul_ps(z, lanes.elements[8 + column]));
+	return isPoint ? _mm256_add_ps(result, lanes.elements[12 + column]) : result;
+}
+
+static void NormalizeLanes(__m256& x, __m256& y, __m256& z)
+{
+	const __m256 length{ _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z))) };
+	x = _mm256_div_ps(x, length);
+	y = _mm256_div_ps(y, length);
+	z = _mm256_div_ps(z, length);
+}
+
+//Bit i of laneBits set -> lane i all ones
+static __m256 LaneBitsToMask(int laneBits)
+{
+	const __m256i laneFlags{ _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128) };
+	return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(laneBits), laneFlags), laneFlags));
+}
+
+uint32_t Renderer::TransformVertexRangeAVX2(const MeshRast& mesh, const Matrix& world, const Matrix& worldViewProjection, const Vector3& cameraOrigin,
+	TransformedVertexStreams& s, uint32_t begin, uint32_t end) const
+{
+	const VertexStreams& in{ mesh.streams };
+
+	//Viewport transform folded into the vertex stage: x_screen = x / w * halfWidth + halfWidth
+	const float halfWidth{ m_Width * 0.5f };
+	const float halfHeight{ m_Height * 0.5f };
+
+	uint32_t i{ begin };
+
+	const MatrixLanes wvpLanes{ BroadcastMatrix(worldViewProjection) };
+	const MatrixLanes worldLanes{ BroadcastMatrix(world) };
+	const __m256 halfWidthLanes{ _mm256_set1_ps(halfWidth) };
+	const __m256 halfHeightLanes{ _mm256_set1_ps(halfHeight) };
+	const __m256 minDepthLanes{ _mm256_set1_ps(g_MinClippedDepth) };
+	const __m256 oneLanes{ _mm256_set1_ps(1.f) };
+	const __m256 originX{ _mm256_set1_ps(cameraOrigin.x) };
+	const __m256 originY{ _mm256_set1_ps(cameraOrigin.y) };
+	const __m256 originZ{ _mm256_set1_ps(cameraOrigin.z) };
+
+	//Raw pointers, so the loop doesn't go through std::vector::operator[]
+	const float* pPositionX{ in.positionX.data() };
+	const float* pPositionY{ in.positionY.data() };
+	const float* pPositionZ{ in.positionZ.data() };
+	const float* pNormalX{ in.normalX.data() };
+	const float* pNormalY{ in.normalY.data() };
+	const float* pNormalZ{ in.normalZ.data() };
+	const float* pTangentX{ in.tangentX.data() };
+	const float* pTangentY{ in.tangentY.data() };
+	const float* pTangentZ{ in.tangentZ.data() };
+	float* pClipX{ s.clipX.data() };
+	float* pClipY{ s.clipY.data() };
+	float* pClipZ{ s.clipZ.data() };
+	float* pClipW{ s.clipW.data() };
+	float* pScreenX{ s.screenX.data() };
+	float* pScreenY{ s.screenY.data() };
+	float* pScreenZ{ s.screenZ.data() };
+	float* pWorldNormalX{ s.worldNormalX.data() };
+	float* pWorldNormalY{ s.worldNormalY.data() };
+	float* pWorldNormalZ{ s.worldNormalZ.data() };
+	float* pWorldTangentX{ s.worldTangentX.data() };
+	float* pWorldTangentY{ s.worldTangentY.data() };
+	float* pWorldTangentZ{ s.worldTangentZ.data() };
+	float* pViewDirectionX{ s.viewDirectionX.data() };
+	float* pViewDirectionY{ s.viewDirectionY.data() };
+	float* pViewDirectionZ{ s.viewDirectionZ.data() };
+
+	for (; i + 8 <= end; i += 8)
+	{
+		//Projection stage
+		const __m256 px{ _mm256_loadu_ps(pPositionX + i) };
+		const __m256 py{ _mm256_loadu_ps(pPositionY + i) };
+		const __m256 pz{ _mm256_loadu_ps(pPositionZ + i) };
+		const __m256 clipX{ TransformLanes(wvpLanes, 0, px, py, pz, true) };
+		const __m256 clipY{ TransformLanes(wvpLanes, 1, px, py, pz, true) };
+		const __m256 clipZ{ TransformLanes(wvpLanes, 2, px, py, pz, true) };
+		const __m256 clipW{ TransformLanes(wvpLanes, 3, px, py, pz, true) };
+		_mm256_storeu_ps(pClipX + i, clipX);
+		_mm256_storeu_ps(pClipY + i, clipY);
+		_mm256_storeu_ps(pClipZ + i, clipZ);
+		_mm256_storeu_ps(pClipW + i, clipW);
+
+		const __m256 invW{ _mm256_div_ps(oneLanes, clipW) };
+		_mm256_storeu_ps(pScreenX + i, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(clipX, invW), halfWidthLanes), halfWidthLanes));
+		_mm256_storeu_ps(pScreenY + i, _mm256_sub_ps(halfHeightLanes, _mm256_mul_ps(_mm256_mul_ps(clipY, invW), halfHeightLanes)));
+		_mm256_storeu_ps(pScreenZ + i, _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(clipZ, invW), minDepthLanes), oneLanes));
+
+		//Normal and tangent to world space, normalized after
+		const __m256 nx{ _mm256_loadu_ps(pNormalX + i) };
+		const __m256 ny{ _mm256_loadu_ps(pNormalY + i) };
+		const __m256 nz{ _mm256_loadu_ps(pNormalZ + i) };
+		__m256 worldNormalX{ TransformLanes(worldLanes, 0, nx, ny, nz, false) };
+		__m256 worldNormalY{ TransformLanes(worldLanes, 1, nx, ny, nz, false) };
+		__m256 worldNormalZ{ TransformLanes(worldLanes, 2, nx, ny, nz, false) };
+		NormalizeLanes(worldNormalX, worldNormalY, worldNormalZ);
+		_mm256_storeu_ps(pWorldNormalX + i, worldNormalX);
+		_mm256_storeu_ps(pWorldNormalY + i, worldNormalY);
+		_mm256_storeu_ps(pWorldNormalZ + i, worldNormalZ);
+
+		const __m256 tx{ _mm256_loadu_ps(pTangentX + i) };
+		const __m256 ty{ _mm256_loadu_ps(pTangentY + i) };
+		const __m256 tz{ _mm256_loadu_ps(pTangentZ + i) };
+		__m256 worldTangentX{ TransformLanes(worldLanes, 0, tx, ty, tz, false) };
+		__m256 worldTangentY{ TransformLanes(worldLanes, 1, tx, ty, tz, false) };
+		__m256 worldTangentZ{ TransformLanes(worldLanes, 2, tx, ty, tz, false) };
+		NormalizeLanes(worldTangentX, worldTangentY, worldTangentZ);
+		_mm256_storeu_ps(pWorldTangentX + i, worldTangentX);
+		_mm256_storeu_ps(pWorldTangentY + i, worldTangentY);
+		_mm256_storeu_ps(pWorldTangentZ + i, worldTangentZ);
+
+		//World position, for the view direction
+		_mm256_storeu_ps(pViewDirectionX + i, _mm256_sub_ps(originX, TransformLanes(worldLanes, 0, px, py, pz, true)));
+		_mm256_storeu_ps(pViewDirectionY + i, _mm256_sub_ps(originY, TransformLanes(worldLanes, 1, px, py, pz, true)));
+		_mm256_storeu_ps(pViewDirectionZ + i, _mm256_sub_ps(originZ, TransformLanes(worldLanes, 2, px, py, pz, true)));
+	}
+
+	return i;
+}
+
+uint64_t Renderer::RasterizeTriangleAVX2(const TriangleRast& triangle, uint32_t triangleIndex, const TileRast& tile,
+	int minX, int minY, int maxX, int maxY, RasterizerStats& stats) const
+{
+	//Tiles are made of whole coarse depth blocks
+	const int tileBlockX{ tile.minX / m_CoarseBlockSize };
+	const int tileBlockY{ tile.minY / m_CoarseBlockSize };
+
+	//One bit per coarse block of this tile that got a depth write
+	uint64_t dirtyBlocks{};
+
+	//Start on a block boundary so every 8-wide step stays inside one coarse block
+	const int firstX{ minX & ~(m_CoarseBlockSize - 1) };
+
+	//Edge values at the first pixel center, after that only the steps get added. Written out instead of Evaluate, see the top
+	const float startX{ firstX + 0.5f };
+	const float startY{ minY + 0.5f };
+	float rowWA{ triangle.edgeBC.a * startX + triangle.edgeBC.b * startY + triangle.edgeBC.c };
+	float rowWB{ triangle.edgeCA.a * startX + triangle.edgeCA.b * startY + triangle.edgeCA.c };
+	float rowWC{ triangle.edgeAB.a * startX + triangle.edgeAB.b * startY + triangle.edgeAB.c };
+
+	const int64_t fixedStartX{ (int64_t(firstX) << g_SubPixelBits) + g_SubPixelScale / 2 };
+	const int64_t fixedStartY{ (int64_t(minY) << g_SubPixelBits) + g_SubPixelScale / 2 };
+	int64_t rowEA{ triangle.fixedBC.a * fixedStartX + triangle.fixedBC.b * fixedStartY + triangle.fixedBC.c };
+	int64_t rowEB{ triangle.fixedCA.a * fixedStartX + triangle.fixedCA.b * fixedStartY + triangle.fixedCA.c };
+	int64_t rowEC{ triangle.fixedAB.a * fixedStartX + triangle.fixedAB.b * fixedStartY + triangle.fixedAB.c };
+	const int64_t stepXEA{ triangle.fixedBC.a << g_SubPixelBits };
+	const int64_t stepXEB{ triangle.fixedCA.a << g_SubPixelBits };
+	const int64_t stepXEC{ triangle.fixedAB.a << g_SubPixelBits };
+	const int64_t stepYEA{ triangle.fixedBC.b << g_SubPixelBits };
+	const int64_t stepYEB{ triangle.fixedCA.b << g_SubPixelBits };
+	const int64_t stepYEC{ triangle.fixedAB.b << g_SubPixelBits };
+
+	//8 pixels of a row per step: coverage, depth test and perspective correction with lane masks
+	const __m256 one{ _mm256_set1_ps(1.f) };
+	const __m256 laneOffsets{ _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f) };
+
+	//The fixed point edges need 64 bits, so lanes 0-3 and 4-7 each get a register
+	const __m256i stepXEA8{ _mm256_set1_epi64x(8 * stepXEA) };
+	const __m256i stepXEB8{ _mm256_set1_epi64x(8 * stepXEB) };
+	const __m256i stepXEC8{ _mm256_set1_epi64x(8 * stepXEC) };
+
+	const __m256 stepXA{ _mm256_set1_ps(8.f * triangle.edgeBC.a) };
+	const __m256 stepXB{ _mm256_set1_ps(8.f * triangle.edgeCA.a) };
+	const __m256 stepXC{ _mm256_set1_ps(8.f * triangle.edgeAB.a) };
+	const __m256 laneStepA{ _mm256_mul_ps(laneOffsets, _mm256_set1_ps(triangle.edgeBC.a)) };
+	const __m256 laneStepB{ _mm256_mul_ps(laneOffsets, _mm256_set1_ps(triangle.edgeCA.a)) };
+	const __m256 laneStepC{ _mm256_mul_ps(laneOffsets, _mm256_set1_ps(triangle.edgeAB.a)) };
+
+	const __m256 invZA{ _mm256_set1_ps(triangle.invZ.x) };
+	const __m256 invZB{ _mm256_set1_ps(triangle.invZ.y) };
+	const __m256 invZC{ _mm256_set1_ps(triangle.invZ.z) };
+	const __m256 invWA{ _mm256_set1_ps(triangle.invW.x) };
+	const __m256 invWB{ _mm256_set1_ps(triangle.invW.y) };
+	const __m256 invWC{ _mm256_set1_ps(triangle.invW.z) };
+
+	for (int py{ minY }; py < maxY; ++py,
+		rowWA += triangle.edgeBC.b, rowWB += triangle.edgeCA.b, rowWC += triangle.edgeAB.b,
+		rowEA += stepYEA, rowEB += stepYEB, rowEC += stepYEC)
+	{
+		__m256 wA{ _mm256_add_ps(_mm256_set1_ps(rowWA), laneStepA) };
+		__m256 wB{ _mm256_add_ps(_mm256_set1_ps(rowWB), laneStepB) };
+		__m256 wC{ _mm256_add_ps(_mm256_set1_ps(rowWC), laneStepC) };
+
+		__m256i eALow{ _mm256_setr_epi64x(rowEA, rowEA + stepXEA, rowEA + 2 * stepXEA, rowEA + 3 * stepXEA) };
+		__m256i eBLow{ _mm256_setr_epi64x(rowEB, rowEB + stepXEB, rowEB + 2 * stepXEB, rowEB + 3 * stepXEB) };
+		__m256i eCLow{ _mm256_setr_epi64x(rowEC, rowEC + stepXEC, rowEC + 2 * stepXEC, rowEC + 3 * stepXEC) };
+		__m256i eAHigh{ _mm256_add_epi64(eALow, _mm256_set1_epi64x(4 * stepXEA)) };
+		__m256i eBHigh{ _mm256_add_epi64(eBLow, _mm256_set1_epi64x(4 * stepXEB)) };
+		__m256i eCHigh{ _mm256_add_epi64(eCLow, _mm256_set1_epi64x(4 * stepXEC)) };
+
+		const int blockY{ py / m_CoarseBlockSize };
+		for (int px{ firstX }; px < maxX; px += 8,
+			wA = _mm256_add_ps(wA, stepXA), wB = _mm256_add_ps(wB, stepXB), wC = _mm256_add_ps(wC, stepXC),
+			eALow = _mm256_add_epi64(eALow, stepXEA8), eBLow = _mm256_add_epi64(eBLow, stepXEB8), eCLow = _mm256_add_epi64(eCLow, stepXEC8),
+			eAHigh = _mm256_add_epi64(eAHigh, stepXEA8), eBHigh = _mm256_add_epi64(eBHigh, stepXEB8), eCHigh = _mm256_add_epi64(eCHigh, stepXEC8))
+		{
+			const int blockX{ px / m_CoarseBlockSize };
+			if (triangle.minZ > m_pCoarseDepthPixels[blockX + blockY * m_NumBlocksX])
+				continue;
+
+			//Coverage: covered when no edge value is negative, lanes outside the bounding box are masked off
+			const int outsideLow{ _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_or_si256(eALow, _mm256_or_si256(eBLow, eCLow)))) };
+			const int outsideHigh{ _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_or_si256(eAHigh, _mm256_or_si256(eBHigh, eCHigh)))) };
+			const int inRow{ (maxX - px >= 8 ? 0xFF : (1 << (maxX - px)) - 1) & (0xFF << (minX > px ? minX - px : 0)) };
+			const int coverage{ ~(outsideLow | (outsideHigh << 4)) & inRow };
+			if (coverage == 0)
+				continue;
+
+			stats.pixelsCovered += __popcnt(uint32_t(coverage));
+
+			__m256 mask{ LaneBitsToMask(coverage) };
+
+			//Depth test
+			float* pDepth{ m_pDepthBufferPixels + px + py * m_Width };
+			const __m256 bufferValueZ{ _mm256_div_ps(one,
+				_mm256_fmadd_ps(invZA, wA, _mm256_fmadd_ps(invZB, wB, _mm256_mul_ps(invZC, wC)))) };
+			const __m256 oldDepth{ _mm256_maskload_ps(pDepth, _mm256_castps_si256(mask)) };
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(bufferValueZ, oldDepth, _CMP_LE_OQ));
+
+			int laneBits{ _mm256_movemask_ps(mask) };
+			stats.depthTestsPassed += __popcnt(uint32_t(laneBits));
+			stats.depthTestsFailed += __popcnt(uint32_t(coverage & ~laneBits));
+			if (laneBits == 0)
+				continue;
+
+			stats.pixelsWritten += __popcnt(uint32_t(_mm256_movemask_ps(_mm256_and_ps(mask, _mm256_cmp_ps(oldDepth, _mm256_set1_ps(FLT_MAX), _CMP_EQ_OQ)))));
+
+			_mm256_maskstore_ps(pDepth, _mm256_castps_si256(mask), bufferValueZ);
+			dirtyBlocks |= uint64_t(1) << ((blockX - tileBlockX) + (blockY - tileBlockY) * (m_TileSize / m_CoarseBlockSize));
+
+			//Deferred: only remember which triangle is visible, shading happens once per pixel after all triangles
+			if (m_UsingVisibilityBuffer)
+			{
+				_mm256_maskstore_epi32(reinterpret_cast<int*>(m_pVisibilityBufferPixels + px + py * m_Width), _mm256_castps_si256(mask), _mm256_set1_epi32(int(triangleIndex)));
+				continue;
+			}
+
+			//Perspective correct weights
+			const __m256 perspA{ _mm256_mul_ps(wA, invWA) };
+			const __m256 perspB{ _mm256_mul_ps(wB, invWB) };
+			const __m256 perspC{ _mm256_mul_ps(wC, invWC) };
+			const __m256 interpolatedW{ _mm256_div_ps(one, _mm256_add_ps(perspA, _mm256_add_ps(perspB, perspC))) };
+
+			alignas(32) float depths[8];
+			alignas(32) float weightsA[8];
+			alignas(32) float weightsB[8];
+			alignas(32) float weightsC[8];
+			_mm256_store_ps(depths, bufferValueZ);
+			_mm256_store_ps(weightsA, _mm256_mul_ps(perspA, interpolatedW));
+			_mm256_store_ps(weightsB, _mm256_mul_ps(perspB, interpolatedW));
+			_mm256_store_ps(weightsC, _mm256_mul_ps(perspC, interpolatedW));
+
+			while (laneBits != 0)
+			{
+				const int lane{ int(_tzcnt_u32(uint32_t(laneBits))) };
+				laneBits &= laneBits - 1;
+
+				ShadePixel(triangle, px + lane, py, weightsA[lane], weightsB[lane], weightsC[lane], depths[lane], stats);
+			}
+		}
+	}
+
+	return dirtyBlocks;
+}
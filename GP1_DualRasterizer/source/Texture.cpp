@@ -7,7 +7,8 @@
 using namespace dae;
 
 
-Texture::Texture(ID3D11Device* pDevice, const std::string& path)
+Texture::Texture(ID3D11Device* pDevice, const std::string& path, Layout layout) :
+	m_Layout{ layout }
 {
 	m_pSurface = IMG_Load(path.c_str());
 
@@ -41,8 +42,7 @@ Texture::Texture(ID3D11Device* pDevice, const std::string& path)
 	hr = pDevice->CreateShaderResourceView(m_pResource, &SRVDesc, &m_pSRV);
 
 
-	m_pSurfacePixels = (uint32_t*)m_pSurface->pixels;
-
+	DecodeTexels();
 }
 Texture::~Texture()
 {
@@ -61,6 +61,8 @@ Texture::~Texture()
 		SDL_FreeSurface(m_pSurface);
 		m_pSurface = nullptr;
 	}
+	delete[] m_pTexels;
+	m_pTexels = nullptr;
 }
 
 ID3D11ShaderResourceView* Texture::GetSRV() const
@@ -70,32 +72,184 @@ ID3D11ShaderResourceView* Texture::GetSRV() const
 
 
 //RASTERIZER
-Texture::Texture(SDL_Surface* pSurface) :
+Texture::Texture(SDL_Surface* pSurface, Layout layout) :
 	m_pSurface{ pSurface },
-	m_pSurfacePixels{ (uint32_t*)pSurface->pixels }
+	m_Layout{ layout }
+{
+	DecodeTexels();
+}
+
+void Texture::DecodeTexels()
 {
+	//Whatever format the image was loaded in, the rasterizer gets one known layout
+	//so sampling is a load and three shifts instead of SDL_GetRGB
+	SDL_Surface* pConverted{ SDL_ConvertSurfaceFormat(m_pSurface, SDL_PIXELFORMAT_ABGR8888, 0) };
+	assert(pConverted != nullptr && "Texture could not be converted");
+
+	SDL_LockSurface(pConverted);
+	BuildMipLevels(pConverted);
+	SDL_UnlockSurface(pConverted);
+	SDL_FreeSurface(pConverted);
+
+	if (m_Layout == Layout::Tiled)
+		TileMipLevels();
+
+	//The surface isn't needed anymore, the GPU copy is already made
+	SDL_FreeSurface(m_pSurface);
+	m_pSurface = nullptr;
+}
+
+void Texture::BuildMipLevels(const SDL_Surface* pConverted)
+{
+	//Sizes of the whole chain, every level halves (rounded down) until 1x1
+	size_t totalTexels{};
+	int width{ pConverted->w };
+	int height{ pConverted->h };
+	while (true)
+	{
+		m_MipLevels.push_back({ width, height, 0, nullptr });
+		totalTexels += size_t(width) * height;
+		if (width == 1 && height == 1)
+			break;
+
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+
+	m_pTexels = new uint32_t[totalTexels];
+	uint32_t* pLevelTexels{ m_pTexels };
+	for (MipLevel& level : m_MipLevels)
+	{
+		level.pTexels = pLevelTexels;
+		pLevelTexels += size_t(level.width) * level.height;
+	}
+
+	const MipLevel& base{ m_MipLevels[0] };
+	for (int y{}; y < base.height; ++y)
+	{
+		const uint8_t* pRow{ static_cast<const uint8_t*>(pConverted->pixels) + y * pConverted->pitch };
+		memcpy(m_pTexels + size_t(y) * base.width, pRow, base.width * sizeof(uint32_t));
+	}
+
+	//Box filter, every texel is the average of the 2x2 texels above it (clamped at odd edges)
+	for (size_t i{ 1 }; i < m_MipLevels.size(); ++i)
+	{
+		const MipLevel& source{ m_MipLevels[i - 1] };
+		MipLevel& level{ m_MipLevels[i] };
+		uint32_t* pDestination{ const_cast<uint32_t*>(level.pTexels) };
+		for (int y{}; y < level.height; ++y)
+		{
+			const int y0{ std::min(y * 2, source.height - 1) };
+			const int y1{ std::min(y * 2 + 1, source.height - 1) };
+			for (int x{}; x < level.width; ++x)
+			{
+				const int x0{ std::min(x * 2, source.width - 1) };
+				const int x1{ std::min(x * 2 + 1, source.width - 1) };
+				const uint32_t texels[4]{
+					source.pTexels[x0 + y0 * source.width], source.pTexels[x1 + y0 * source.width],
+					source.pTexels[x0 + y1 * source.width], source.pTexels[x1 + y1 * source.width] };
+
+				uint32_t average{};
+				for (int shift{}; shift < 32; shift += 8)
+				{
+					uint32_t sum{ 2 }; //rounds to nearest
+					for (uint32_t texel : texels)
+						sum += (texel >> shift) & 0xFF;
+					average |= (sum / 4) << shift;
+				}
+				pDestination[x + y * level.width] = average;
+			}
+		}
+	}
+}
+
+void Texture::TileMipLevels()
+{
+	//Neighbouring texels in any direction now mostly share a cache line, instead of only along a row
+	using namespace TextureSampling;
+
+	size_t totalTexels{};
+	for (MipLevel& level : m_MipLevels)
+	{
+		level.tilesX = GetNumTiles(level.width);
+		totalTexels += size_t(level.tilesX) * GetNumTiles(level.height) * g_TileSize * g_TileSize;
+	}
+
+	uint32_t* pTiledTexels{ new uint32_t[totalTexels] };
+	uint32_t* pLevelTexels{ pTiledTexels };
+	for (MipLevel& level : m_MipLevels)
+	{
+		const int paddedWidth{ level.tilesX << g_TileBits };
+		const int paddedHeight{ GetNumTiles(level.height) << g_TileBits };
+
+		//Padding repeats the last row/column, it's never addressed
+		MipLevel tiled{ level };
+		tiled.pTexels = pLevelTexels;
+		for (int y{}; y < paddedHeight; ++y)
+		{
+			for (int x{}; x < paddedWidth; ++x)
+			{
+				const uint32_t texel{ level.pTexels[std::min(x, level.width - 1) + std::min(y, level.height - 1) * level.width] };
+				pLevelTexels[TiledIndex(x, y, tiled.tilesX)] = texel;
+			}
+		}
+
+		pLevelTexels += size_t(paddedWidth) * paddedHeight;
+		level = tiled;
+	}
+
+	delete[] m_pTexels;
+	m_pTexels = pTiledTexels;
+}
+
+void Texture::ReleaseTexels()
+{
+	delete[] m_pTexels;
+	m_pTexels = nullptr;
+	m_MipLevels.clear();
+}
+
+uint32_t Texture::FetchPacked(int level, int x, int y) const
+{
+	assert(level < int(m_MipLevels.size()) && "The texels were released, sample the MaterialTexture instead");
+	const MipLevel& mip{ m_MipLevels[level] };
+	if (m_Layout == Layout::Linear)
+		return mip.pTexels[x + y * mip.width];
+
+	return mip.pTexels[TextureSampling::TiledIndex(x, y, mip.tilesX)];
 }
 
 Texture* Texture::LoadFromFile(const std::string& path)
 {
+	//The paths can come from the command line, so a missing or broken file is up to the caller
 	const auto loadedImage{ IMG_Load(path.c_str()) };
-	assert(loadedImage != nullptr && "There was no file found");
+	if (loadedImage == nullptr)
+		return nullptr;
 
 	Texture* imageTexture = new Texture{ loadedImage };
 	return imageTexture;
 }
 
 
-ColorRGB Texture::Sample(const dae::Vector2& uv) const
+ColorRGB Texture::Fetch(int level, int x, int y) const
 {
-	Uint8 r, g, b;
-
-	const size_t x{ size_t(uv.x * m_pSurface->w) };
-	const size_t y{ size_t(uv.y * m_pSurface->h) };
+	const uint32_t texel{ FetchPacked(level, x, y) };
 
-	const Uint32 pixel{ m_pSurfacePixels[x + y * m_pSurface->w] };
+	constexpr float toUnit{ 1.f / 255.f };
+	return { (texel & 0xFF) * toUnit, ((texel >> 8) & 0xFF) * toUnit, ((texel >> 16) & 0xFF) * toUnit };
+}
 
-	SDL_GetRGB(pixel, m_pSurface->format, &r, &g, &b);
+ColorRGB Texture::Sample(const dae::Vector2& uv) const
+{
+	assert(!m_MipLevels.empty() && "The texels were released, sample the MaterialTexture instead");
 
-	return { r / 255.f, g / 255.f, b / 255.f };
+	//Wrapped like the filtered path, uvs outside 0..1 (and uv == 1) stay on the texture
+	return TextureSampling::SamplePoint(*this, 0, uv);
 }
+
+ColorRGB Texture::Sample(const dae::Vector2& uv, const dae::Vector2& dUVdx, const dae::Vector2& dUVdy) const
+{
+	assert(!m_MipLevels.empty() && "The texels were released, sample the MaterialTexture instead");
+	int numFetches{};
+	return TextureSampling::Sample(*this, m_Filter, uv, dUVdx, dUVdy, numFetches);
+}
\ No newline at end of file
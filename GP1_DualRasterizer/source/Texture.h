@@ -2,6 +2,7 @@
 
 #include <SDL_surface.h>
 #include "ColorRGB.h"
+#include "TextureSampling.h"
 
 using namespace dae;
 
@@ -10,22 +11,66 @@ class Vector2;
 class Texture final
 {
 public:
-	Texture(ID3D11Device* pDevice, const std::string& path);
+	//Order of the software texels in memory
+	enum class Layout
+	{
+		Linear, //scanlines
+		Tiled   //4x4 blocks of 64 bytes (one cache line), row by row
+	};
+
+	Texture(ID3D11Device* pDevice, const std::string& path, Layout layout = Layout::Tiled);
 	~Texture();
 
 	//DirectX
 	ID3D11ShaderResourceView* GetSRV() const;
 
 	//Rasterizer
-	Texture(SDL_Surface* pSurface);
+	using Filter = TextureSampling::Filter;
+
+	Texture(SDL_Surface* pSurface, Layout layout = Layout::Tiled);
+	//Nearest texel of the full resolution level
 	ColorRGB Sample(const dae::Vector2& uv) const;
+	//Filtered, the mip level comes from the screen space uv derivatives
+	ColorRGB Sample(const dae::Vector2& uv, const dae::Vector2& dUVdx, const dae::Vector2& dUVdy) const;
+	void SetFilter(Filter filter) { m_Filter = filter; };
+	//nullptr when the image can't be loaded
 	static Texture* LoadFromFile(const std::string& path);
+	//Frees the software texels and mip chain, for textures that were packed into a MaterialTexture.
+	//Only the DirectX side is usable after this, sampling or fetching a released texture asserts
+	void ReleaseTexels();
+
+	//Sampling source, see TextureSampling.h
+	int GetNumMipLevels() const { return int(m_MipLevels.size()); };
+	int GetWidth(int level) const { return m_MipLevels[level].width; };
+	int GetHeight(int level) const { return m_MipLevels[level].height; };
+	ColorRGB Fetch(int level, int x, int y) const;
+	//Raw texel, R in the low byte, then G, B and A
+	uint32_t FetchPacked(int level, int x, int y) const;
 
 private:
 	ID3D11Texture2D* m_pResource{ nullptr };
 	ID3D11ShaderResourceView* m_pSRV{ nullptr };
 
 	SDL_Surface* m_pSurface{ nullptr };
-	uint32_t* m_pSurfacePixels{ nullptr };
+
+	struct MipLevel
+	{
+		int width{};
+		int height{};
+		//Blocks per row when tiled, the level is padded to whole blocks
+		int tilesX{};
+		const uint32_t* pTexels{ nullptr };
+	};
+
+	//Decoded once at load: one uint32_t per texel, R in the low byte, then G, B and A.
+	//Every mip level lives in this one allocation, level 0 first
+	uint32_t* m_pTexels{ nullptr };
+	std::vector<MipLevel> m_MipLevels{};
+	Filter m_Filter{ Filter::Point };
+	Layout m_Layout{ Layout::Tiled };
+
+	void DecodeTexels();
+	void BuildMipLevels(const SDL_Surface* pConverted);
+	void TileMipLevels();
 };
 
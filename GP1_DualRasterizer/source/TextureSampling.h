@@ -0,0 +1,154 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include "Vector2.h"
+
+//Filtering shared by the software textures, independent of what a texel holds.
+//A source has GetNumMipLevels(), GetWidth(level), GetHeight(level) and Fetch(level, x, y),
+//Fetch returns a decoded texel that can be added and scaled by a float
+namespace TextureSampling
+{
+	//Same filters as the techniques of the hardware path
+	enum class Filter
+	{
+		Point,
+		Linear,
+		Anisotropic
+	};
+
+	//Texels per side of a block in the tiled layout, 4x4 texels of 4 bytes is one cache line
+	constexpr int g_TileBits{ 2 };
+	constexpr int g_TileSize{ 1 << g_TileBits };
+	constexpr int g_TileMask{ g_TileSize - 1 };
+
+	//Maximum number of trilinear taps along the longest axis of the pixel footprint (D3D default for anisotropic)
+	constexpr int g_MaxAnisotropy{ 16 };
+
+	inline int GetNumTiles(int size)
+	{
+		return (size + g_TileMask) >> g_TileBits;
+	}
+
+	//Index of texel (x, y) in a level stored as 4x4 blocks, tilesX blocks per row
+	inline size_t TiledIndex(int x, int y, int tilesX)
+	{
+		return (size_t((y >> g_TileBits) * tilesX + (x >> g_TileBits)) << (2 * g_TileBits)) +
+			(y & g_TileMask) * g_TileSize + (x & g_TileMask);
+	}
+
+	//Wrap address mode, like the samplers in the effect
+	inline int WrapTexel(int coordinate, int size)
+	{
+		coordinate %= size;
+		return coordinate < 0 ? coordinate + size : coordinate;
+	}
+
+	template<typename Texel>
+	Texel LerpTexel(const Texel& from, const Texel& to, float factor)
+	{
+		return from * (1.f - factor) + to * factor;
+	}
+
+	template<typename Source>
+	float CalculateLod(const Source& source, const dae::Vector2& dUVdx, const dae::Vector2& dUVdy)
+	{
+		//Footprint of the pixel in texels of level 0, the longest side picks the level
+		const dae::Vector2 texelsDx{ dUVdx.x * source.GetWidth(0), dUVdx.y * source.GetHeight(0) };
+		const dae::Vector2 texelsDy{ dUVdy.x * source.GetWidth(0), dUVdy.y * source.GetHeight(0) };
+		const float lengthSquared{ std::max(texelsDx.SqrMagnitude(), texelsDy.SqrMagnitude()) };
+		if (lengthSquared <= 1.f)
+			return 0.f;
+
+		return 0.5f * std::log2(lengthSquared);
+	}
+
+	template<typename Source>
+	auto SamplePoint(const Source& source, int level, const dae::Vector2& uv)
+	{
+		const int width{ source.GetWidth(level) };
+		const int height{ source.GetHeight(level) };
+		return source.Fetch(level, WrapTexel(int(std::floor(uv.x * width)), width), WrapTexel(int(std::floor(uv.y * height)), height));
+	}
+
+	template<typename Source>
+	auto SampleBilinear(const Source& source, int level, const dae::Vector2& uv)
+	{
+		const int width{ source.GetWidth(level) };
+		const int height{ source.GetHeight(level) };
+
+		//Texel centers are at .5
+		const float x{ uv.x * width - 0.5f };
+		const float y{ uv.y * height - 0.5f };
+		const float floorX{ std::floor(x) };
+		const float floorY{ std::floor(y) };
+		const float fractionX{ x - floorX };
+		const float fractionY{ y - floorY };
+
+		const int x0{ WrapTexel(int(floorX), width) };
+		const int y0{ WrapTexel(int(floorY), height) };
+		const int x1{ x0 + 1 == width ? 0 : x0 + 1 };
+		const int y1{ y0 + 1 == height ? 0 : y0 + 1 };
+
+		const auto top{ LerpTexel(source.Fetch(level, x0, y0), source.Fetch(level, x1, y0), fractionX) };
+		const auto bottom{ LerpTexel(source.Fetch(level, x0, y1), source.Fetch(level, x1, y1), fractionX) };
+		return LerpTexel(top, bottom, fractionY);
+	}
+
+	//numFetches gets the texels read added: 4 at either end of the mip chain, 8 in between
+	template<typename Source>
+	auto SampleTrilinear(const Source& source, float lod, const dae::Vector2& uv, int& numFetches)
+	{
+		const int lastLevel{ source.GetNumMipLevels() - 1 };
+		if (lod <= 0.f || lod >= float(lastLevel))
+		{
+			numFetches += 4;
+			return SampleBilinear(source, lod <= 0.f ? 0 : lastLevel, uv);
+		}
+
+		numFetches += 8;
+		const int level{ int(lod) };
+		return LerpTexel(SampleBilinear(source, level, uv), SampleBilinear(source, level + 1, uv), lod - float(level));
+	}
+
+	//numFetches gets the texels read added, so the cost of the filter can be counted (see RasterizerStats::textureSamples)
+	template<typename Source>
+	auto Sample(const Source& source, Filter filter, const dae::Vector2& uv, const dae::Vector2& dUVdx, const dae::Vector2& dUVdy, int& numFetches)
+	{
+		switch (filter)
+		{
+		case Filter::Point:
+		{
+			//Nearest texel of the nearest level
+			const int level{ std::min(int(CalculateLod(source, dUVdx, dUVdy) + 0.5f), source.GetNumMipLevels() - 1) };
+			++numFetches;
+			return SamplePoint(source, level, uv);
+		}
+		case Filter::Linear:
+			return SampleTrilinear(source, CalculateLod(source, dUVdx, dUVdy), uv, numFetches);
+		default:
+		{
+			//Several trilinear taps along the long axis of the footprint, each sized by the short axis
+			const dae::Vector2 texelsDx{ dUVdx.x * source.GetWidth(0), dUVdx.y * source.GetHeight(0) };
+			const dae::Vector2 texelsDy{ dUVdy.x * source.GetWidth(0), dUVdy.y * source.GetHeight(0) };
+			const float lengthX{ texelsDx.Magnitude() };
+			const float lengthY{ texelsDy.Magnitude() };
+			const float major{ std::max(lengthX, lengthY) };
+			const float minor{ std::min(lengthX, lengthY) };
+			if (minor <= 0.f || major <= 1.f)
+				return SampleTrilinear(source, CalculateLod(source, dUVdx, dUVdy), uv, numFetches);
+
+			const int numTaps{ std::min(int(std::ceil(major / minor)), g_MaxAnisotropy) };
+			const float lod{ std::max(std::log2(major / numTaps), 0.f) };
+			const dae::Vector2 majorAxis{ lengthX > lengthY ? dUVdx : dUVdy };
+
+			auto sum{ SampleTrilinear(source, lod, uv + majorAxis * (0.5f / numTaps - 0.5f), numFetches) };
+			for (int tap{ 1 }; tap < numTaps; ++tap)
+			{
+				const float offset{ (tap + 0.5f) / numTaps - 0.5f };
+				sum = sum + SampleTrilinear(source, lod, uv + majorAxis * offset, numFetches);
+			}
+			return sum * (1.f / numTaps);
+		}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "pch.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+namespace dae
+{
+	ThreadPool::ThreadPool(uint32_t numThreads)
+	{
+		if (numThreads == 0)
+			numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+		//The thread calling ParallelFor also does work
+		m_Workers.reserve(numThreads - 1);
+		for (uint32_t i{ 1 }; i < numThreads; ++i)
+		{
+			m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_WakeCondition.notify_all();
+
+		for (auto& worker : m_Workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& job)
+	{
+		if (count == 0)
+			return;
+
+		if (m_Workers.empty() || count == 1)
+		{
+			for (uint32_t i{}; i < count; ++i)
+				job(i);
+			return;
+		}
+
+		Job current{};
+		current.pFunction = &job;
+		current.count = count;
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_pJobs.push_back(&current);
+		}
+		m_WakeCondition.notify_all();
+
+		RunJobs(current);
+
+		//No new workers can pick it up after this, then wait for the ones still busy with their last index
+		std::unique_lock lock{ m_Mutex };
+		m_pJobs.erase(std::find(m_pJobs.begin(), m_pJobs.end(), &current));
+		m_DoneCondition.wait(lock, [&current]() { return current.numBusy == 0; });
+	}
+
+	void ThreadPool::WorkerLoop()
+	{
+		PROFILE_THREAD_NAME("Thread pool worker");
+
+		while (true)
+		{
+			Job* pJob{};
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_WakeCondition.wait(lock, [&]() { return m_IsStopping || (pJob = FindJob()) != nullptr; });
+				if (m_IsStopping)
+					return;
+
+				++pJob->numBusy;
+			}
+
+			{
+				PROFILE_ZONE("Thread pool job");
+				RunJobs(*pJob);
+			}
+
+			{
+				std::lock_guard lock{ m_Mutex };
+				--pJob->numBusy;
+			}
+			//Several callers can be waiting, each for its own job
+			m_DoneCondition.notify_all();
+		}
+	}
+
+	ThreadPool::Job* ThreadPool::FindJob() const
+	{
+		for (Job* pJob : m_pJobs)
+		{
+			if (pJob->nextIndex < pJob->count)
+				return pJob;
+		}
+		return nullptr;
+	}
+
+	void ThreadPool::RunJobs(Job& job)
+	{
+		for (uint32_t i{ job.nextIndex++ }; i < job.count; i = job.nextIndex++)
+		{
+			(*job.pFunction)(i);
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	class ThreadPool final
+	{
+	public:
+		//0 threads = one per hardware thread (the calling thread counts as one)
+		explicit ThreadPool(uint32_t numThreads = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		//Calls job(index) for every index in [0, count), spread over the workers and the calling thread.
+		//Returns once every index is done. Can be called from several threads at once, idle workers help the oldest
+		//job that still has indices left, so the jobs of different callers run at the same time
+		void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& job);
+
+		uint32_t GetNumThreads() const { return uint32_t(m_Workers.size()) + 1; };
+
+	private:
+		//One ParallelFor call, lives on the stack of its caller
+		struct Job
+		{
+			const std::function<void(uint32_t)>* pFunction{ nullptr };
+			uint32_t count{};
+			std::atomic<uint32_t> nextIndex{};
+			//Workers inside RunJobs of this job, guarded by m_Mutex
+			uint32_t numBusy{};
+		};
+
+		std::vector<std::thread> m_Workers{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WakeCondition{};
+		std::condition_variable m_DoneCondition{};
+
+		//Jobs in submission order, a job is removed by its caller once its own indices ran out
+		std::vector<Job*> m_pJobs{};
+		bool m_IsStopping{ false };
+
+		void WorkerLoop();
+		//Oldest job with indices left, needs m_Mutex
+		Job* FindJob() const;
+		static void RunJobs(Job& job);
+	};
+}
@@ -1,12 +1,37 @@
 #pragma once
 #include <fstream>
+#include <unordered_map>
 #include "Math.h"
 
 namespace dae
 {
 	namespace Utils
 	{
-		//Just parses vertices and indices
+		//Position, uv and normal index of a face corner, identical corners share one vertex
+		struct ObjCornerKey
+		{
+			size_t position{};
+			size_t texCoord{};
+			size_t normal{};
+
+			bool operator==(const ObjCornerKey& other) const
+			{
+				return position == other.position && texCoord == other.texCoord && normal == other.normal;
+			}
+		};
+
+		struct ObjCornerKeyHash
+		{
+			size_t operator()(const ObjCornerKey& key) const
+			{
+				size_t hash{ std::hash<size_t>{}(key.position) };
+				hash ^= std::hash<size_t>{}(key.texCoord) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+				hash ^= std::hash<size_t>{}(key.normal) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+				return hash;
+			}
+		};
+
+		//Just parses vertices and indices, face corners with the same position/uv/normal are welded into one vertex
 #pragma warning(push)
 #pragma warning(disable : 4505) //Warning unreferenced local function
 		static bool ParseOBJ(const std::string& filename, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, bool flipAxisAndWinding = true)
@@ -22,12 +47,13 @@ namespace dae
 			vertices.clear();
 			indices.clear();
 
+			std::unordered_map<ObjCornerKey, uint32_t, ObjCornerKeyHash> cornerToVertex{};
+
 			std::string sCommand;
-			// start a while iteration ending when the end of file is reached (ios::eof)
-			while (!file.eof())
+			//read the first word of every line, use the >> operator (istream::operator>>).
+			//Stops when that fails at the end of the file, instead of handling the last command a second time
+			while (file >> sCommand)
 			{
-				//read the first word of the string, use the >> operator (istream::operator>>) 
-				file >> sCommand;
 				//use conditional statements to process the different commands	
 				if (sCommand == "#")
 				{
@@ -64,12 +90,17 @@ namespace dae
 					//add the material index as attibute to the attribute array
 					//
 					// Faces or triangles
-					Vertex vertex{};
 					size_t iPosition, iTexCoord, iNormal;
 
 					uint32_t tempIndices[3];
 					for (size_t iFace = 0; iFace < 3; iFace++)
 					{
+						//Per corner, so a missing uv or normal stays zero instead of coming from the previous corner
+						Vertex vertex{};
+						//0 = not in the file (OBJ indices start at 1)
+						iTexCoord = 0;
+						iNormal = 0;
+
 						// OBJ format uses 1-based arrays
 						file >> iPosition;
 						vertex.position = positions[iPosition - 1];
@@ -95,8 +126,12 @@ namespace dae
 							}
 						}
 
-						vertices.push_back(vertex);
-						tempIndices[iFace] = uint32_t(vertices.size()) - 1;
+						//Reuse the vertex if this corner was seen before
+						const auto [it, isNew] { cornerToVertex.try_emplace({ iPosition, iTexCoord, iNormal }, uint32_t(vertices.size())) };
+						if (isNew)
+							vertices.push_back(vertex);
+
+						tempIndices[iFace] = it->second;
 						//indices.push_back(uint32_t(vertices.size()) - 1);
 					}
 
@@ -134,7 +169,12 @@ namespace dae
 				const Vector3 edge1 = p2 - p0;
 				const Vector2 diffX = Vector2(uv1.x - uv0.x, uv2.x - uv0.x);
 				const Vector2 diffY = Vector2(uv1.y - uv0.y, uv2.y - uv0.y);
-				float r = 1.f / Vector2::Cross(diffX, diffY);
+				//Degenerate uvs would give an inf/NaN tangent, and welded corners would pass it on to every neighbour.
+				//The epsilon is far below the uv area of one texel of a 2048 texture
+				const float uvArea = Vector2::Cross(diffX, diffY);
+				if (AreEqual(uvArea, 0.f, 1e-12f))
+					continue;
+				float r = 1.f / uvArea;
 
 				Vector3 tangent = (edge0 * diffY.y - edge1 * diffY.x) * r;
 				vertices[index0].tangent += tangent;
@@ -145,7 +185,11 @@ namespace dae
 			//Create the Tangents (reject)
 			for (auto& v : vertices)
 			{
-				v.tangent = Vector3::Reject(v.tangent, v.normal).Normalized();
+				v.tangent = Vector3::Reject(v.tangent, v.normal);
+				//Only degenerate uvs around this vertex, any direction perpendicular to the normal will do
+				if (AreEqual(v.tangent.SqrMagnitude(), 0.f, 1e-12f))
+					v.tangent = Vector3::Cross(std::abs(v.normal.x) < 0.9f ? Vector3::UnitX : Vector3::UnitY, v.normal);
+				v.tangent.Normalize();
 
 				if(flipAxisAndWinding)
 				{
@@ -0,0 +1,72 @@
+#include "pch.h"
+#include "WorkerThread.h"
+#include "Profiler.h"
+
+namespace dae
+{
+	WorkerThread::WorkerThread()
+	{
+		m_Thread = std::thread{ &WorkerThread::Loop, this };
+	}
+
+	WorkerThread::~WorkerThread()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_WakeCondition.notify_one();
+		m_Thread.join();
+	}
+
+	uint64_t WorkerThread::Submit(std::function<void()> task)
+	{
+		uint64_t ticket{};
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_Tasks.push_back(std::move(task));
+			ticket = ++m_NumSubmitted;
+		}
+		m_WakeCondition.notify_one();
+		return ticket;
+	}
+
+	void WorkerThread::Wait(uint64_t ticket)
+	{
+		std::unique_lock lock{ m_Mutex };
+		m_DoneCondition.wait(lock, [&]() { return m_NumDone >= ticket; });
+	}
+
+	void WorkerThread::WaitAll()
+	{
+		std::unique_lock lock{ m_Mutex };
+		m_DoneCondition.wait(lock, [this]() { return m_NumDone == m_NumSubmitted; });
+	}
+
+	void WorkerThread::Loop()
+	{
+		PROFILE_THREAD_NAME("Frame thread");
+
+		while (true)
+		{
+			std::function<void()> task{};
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_WakeCondition.wait(lock, [this]() { return m_IsStopping || !m_Tasks.empty(); });
+				if (m_Tasks.empty())
+					return;
+
+				task = std::move(m_Tasks.front());
+				m_Tasks.pop_front();
+			}
+
+			task();
+
+			{
+				std::lock_guard lock{ m_Mutex };
+				++m_NumDone;
+			}
+			m_DoneCondition.notify_all();
+		}
+	}
+}
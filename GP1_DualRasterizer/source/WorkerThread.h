@@ -0,0 +1,47 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace dae
+{
+	//One background thread that runs tasks in the order they were submitted
+	class WorkerThread final
+	{
+	public:
+		WorkerThread();
+		//Finishes every queued task first
+		~WorkerThread();
+
+		WorkerThread(const WorkerThread&) = delete;
+		WorkerThread(WorkerThread&&) noexcept = delete;
+		WorkerThread& operator=(const WorkerThread&) = delete;
+		WorkerThread& operator=(WorkerThread&&) noexcept = delete;
+
+		//Returns a ticket for Wait
+		uint64_t Submit(std::function<void()> task);
+		//Returns once the task with this ticket (and every task before it) is done
+		void Wait(uint64_t ticket);
+		void WaitAll();
+
+	private:
+		std::mutex m_Mutex{};
+		std::condition_variable m_WakeCondition{};
+		std::condition_variable m_DoneCondition{};
+
+		std::deque<std::function<void()>> m_Tasks{};
+		uint64_t m_NumSubmitted{};
+		uint64_t m_NumDone{};
+		bool m_IsStopping{ false };
+
+		//Last, so everything above exists before the thread starts
+		std::thread m_Thread{};
+
+		void Loop();
+	};
+}
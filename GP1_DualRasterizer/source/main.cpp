@@ -6,22 +6,413 @@
 
 #undef main
 #include "Renderer.h"
+#include "FrameWriter.h"
+#include "Benchmark.h"
+#include "Profiler.h"
+#include "CommandLine.h"
+#include <chrono>
+#include <fstream>
 
 using namespace dae;
 
 bool g_PrintPFS{ true };
 
+//BATCH MODE
+//Any command line argument renders an image sequence headless instead of opening the window:
+//  --output <pattern>   required, printf style frame number, e.g. frames/frame_%05d.png (.bmp for bitmaps)
+//  --frames <count>     default 1
+//  --size <W>x<H>       default 640x480
+//  --poses <file>       camera keyframes, one "x y z pitch yaw" (degrees) per line, spread evenly over the frames
+//  --mesh, --diffuse, --normal, --specular, --gloss <file>   default the vehicle
+//  --writers <count>    threads encoding and writing images, default 2
+//  --trace <file>       chrome://tracing / Perfetto json of the profiler zones (Release with /p:EnableProfiler=true), also for benchmarks
+//  --simd <avx2|scalar> rasterizer kernels, default avx2 when the cpu has it, also for benchmarks
+//  --pipeline-depth <1-3> software frames in flight, 1 = no overlap, default 2, also for benchmarks
+//BENCHMARK MODE
+//  --benchmark <file>   replays a fixed camera and rotation script headless and writes frame time stats as json
+//  --warmup <count>     frames rendered before recording, default 60
+//  --frames <count>     recorded frames, default 600
+//  --baseline <file>    json of an earlier run, the exit code is 1 when this run is slower
+//  --tolerance <factor> allowed slowdown against the baseline, default 0.05
+struct CameraPose
+{
+	Vector3 origin{};
+	float pitch{};
+	float yaw{};
+};
+
+struct CommandLineOptions
+{
+	SoftwareScene scene{};
+	int width{ 640 };
+	int height{ 480 };
+	//0 = the default of the mode
+	uint32_t numFrames{};
+	uint32_t numWriters{ 2 };
+	std::string posesPath{};
+	std::string outputPattern{};
+	std::string tracePath{};
+	bool useAVX2{ true };
+	uint32_t pipelineDepth{ 2 };
+
+	std::string benchmarkPath{};
+	std::string baselinePath{};
+	uint32_t warmupFrames{ 60 };
+	float tolerance{ 0.05f };
+};
+
+static bool ParseCommandLineOptions(int argc, char* args[], CommandLineOptions& options)
+{
+	for (int i{ 1 }; i < argc; ++i)
+	{
+		const std::string option{ args[i] };
+		if (i + 1 >= argc)
+		{
+			std::cout << "Missing value for " << option << '\n';
+			return false;
+		}
+		const std::string value{ args[++i] };
+
+		if (option == "--output")
+			options.outputPattern = value;
+		else if (option == "--frames")
+		{
+			if (!ParseNumber(option, value, options.numFrames))
+				return false;
+		}
+		else if (option == "--size")
+		{
+			if (std::sscanf(value.c_str(), "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+			{
+				std::cout << "Invalid size " << value << ", expected <width>x<height>\n";
+				return false;
+			}
+		}
+		else if (option == "--poses")
+			options.posesPath = value;
+		else if (option == "--mesh")
+			options.scene.meshPath = value;
+		else if (option == "--diffuse")
+			options.scene.diffusePath = value;
+		else if (option == "--normal")
+			options.scene.normalPath = value;
+		else if (option == "--specular")
+			options.scene.specularPath = value;
+		else if (option == "--gloss")
+			options.scene.glossPath = value;
+		else if (option == "--writers")
+		{
+			if (!ParseNumber(option, value, options.numWriters))
+				return false;
+		}
+		else if (option == "--trace")
+			options.tracePath = value;
+		else if (option == "--simd")
+		{
+			if (value != "avx2" && value != "scalar")
+			{
+				std::cout << "Invalid simd " << value << ", expected avx2 or scalar\n";
+				return false;
+			}
+			options.useAVX2 = value == "avx2";
+		}
+		else if (option == "--pipeline-depth")
+		{
+			if (!ParseNumber(option, value, options.pipelineDepth))
+				return false;
+			if (options.pipelineDepth < 1 || options.pipelineDepth > 3)
+			{
+				std::cout << "Invalid pipeline depth " << value << ", expected 1, 2 or 3\n";
+				return false;
+			}
+		}
+		else if (option == "--benchmark")
+			options.benchmarkPath = value;
+		else if (option == "--baseline")
+			options.baselinePath = value;
+		else if (option == "--warmup")
+		{
+			if (!ParseNumber(option, value, options.warmupFrames))
+				return false;
+		}
+		else if (option == "--tolerance")
+		{
+			if (!ParseNumber(option, value, options.tolerance))
+				return false;
+		}
+		else
+		{
+			std::cout << "Unknown option " << option << '\n';
+			return false;
+		}
+	}
+
+	if (!options.benchmarkPath.empty())
+		return true;
+
+	//Exactly one integer conversion, the pattern goes straight to snprintf
+	const size_t percent{ options.outputPattern.find('%') };
+	const size_t conversion{ options.outputPattern.find_first_not_of("0123456789", percent + 1) };
+	if (percent == std::string::npos || conversion == std::string::npos || options.outputPattern[conversion] != 'd' ||
+		options.outputPattern.find('%', percent + 1) != std::string::npos)
+	{
+		std::cout << "--output needs a pattern with one frame number, e.g. frames/frame_%05d.png\n";
+		return false;
+	}
+
+	return true;
+}
+
+static bool LoadCameraPoses(const std::string& path, std::vector<CameraPose>& poses)
+{
+	std::ifstream file{ path };
+	if (!file)
+		return false;
+
+	std::string line{};
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		CameraPose pose{};
+		std::istringstream lineStream{ line };
+		if (!(lineStream >> pose.origin.x >> pose.origin.y >> pose.origin.z >> pose.pitch >> pose.yaw))
+			return false;
+
+		pose.pitch *= TO_RADIANS;
+		pose.yaw *= TO_RADIANS;
+		poses.push_back(pose);
+	}
+	return !poses.empty();
+}
+
+//Linear between the keyframes, the first and last keyframe land on the first and last frame
+static CameraPose SampleCameraPath(const std::vector<CameraPose>& poses, uint32_t frame, uint32_t numFrames)
+{
+	if (poses.size() == 1 || numFrames <= 1)
+		return poses.front();
+
+	const float position{ float(frame) / (numFrames - 1) * (poses.size() - 1) };
+	const size_t from{ std::min(size_t(position), poses.size() - 2) };
+	const float factor{ position - from };
+
+	const CameraPose& a{ poses[from] };
+	const CameraPose& b{ poses[from + 1] };
+	return { a.origin + (b.origin - a.origin) * factor, Lerpf(a.pitch, b.pitch, factor), Lerpf(a.yaw, b.yaw, factor) };
+}
+
+static std::string FramePath(const std::string& pattern, uint32_t frame)
+{
+	std::vector<char> path(pattern.size() + 32);
+	std::snprintf(path.data(), path.size(), pattern.c_str(), int(frame));
+	return path.data();
+}
+
+static bool CanOpenScene(const SoftwareScene& scene)
+{
+	for (const std::string& path : { scene.meshPath, scene.diffusePath, scene.normalPath, scene.specularPath, scene.glossPath })
+	{
+		if (!std::ifstream{ path })
+		{
+			std::cout << "Could not open " << path << '\n';
+			return false;
+		}
+	}
+	return true;
+}
+
+static int RunBatch(const CommandLineOptions& options)
+{
+	if (!CanOpenScene(options.scene))
+		return 1;
+
+	const uint32_t numFrames{ options.numFrames == 0 ? 1 : options.numFrames };
+
+	//Without keyframes the camera stays where the windowed renderer starts
+	std::vector<CameraPose> poses{};
+	if (options.posesPath.empty())
+		poses.push_back({});
+	else if (!LoadCameraPoses(options.posesPath, poses))
+	{
+		std::cout << "Could not read camera poses from " << options.posesPath << '\n';
+		return 1;
+	}
+
+	//No window, so no video subsystem either
+	SDL_Init(0);
+
+	const auto pRenderer = new Renderer(options.width, options.height, options.scene);
+	if (!pRenderer->IsInitialized())
+	{
+		std::cout << "Could not load the scene: " << SDL_GetError() << '\n';
+		delete pRenderer;
+		SDL_Quit();
+		return 1;
+	}
+	pRenderer->SetAVX2KernelsEnabled(options.useAVX2);
+	pRenderer->SetFramePipelineDepth(options.pipelineDepth);
+	const auto pWriter = new FrameWriter(options.width, options.height, options.numWriters);
+
+	//Frames come out in order, a few frames after they were submitted because of the frame pipelining
+	uint32_t numWritten{};
+	pRenderer->SetPresentCallback([&](const uint32_t* pPixels)
+		{
+			pWriter->Write(pPixels, FramePath(options.outputPattern, numWritten++));
+		});
+
+	const auto start{ std::chrono::steady_clock::now() };
+	for (uint32_t frame{}; frame < numFrames; ++frame)
+	{
+		const CameraPose pose{ SampleCameraPath(poses, frame, numFrames) };
+		pRenderer->SetCameraPose(pose.origin, pose.pitch, pose.yaw);
+		pRenderer->Render();
+	}
+	pRenderer->FlushSoftwareFrames();
+	const auto rendered{ std::chrono::steady_clock::now() };
+
+	pWriter->Flush();
+	const auto written{ std::chrono::steady_clock::now() };
+	if (!options.tracePath.empty())
+		Profiler::WriteChromeTrace(options.tracePath);
+	const uint32_t numFailed{ pWriter->GetNumFailed() };
+
+	delete pRenderer;
+	delete pWriter;
+	SDL_Quit();
+
+	const float renderSeconds{ std::chrono::duration<float>(rendered - start).count() };
+	const float totalSeconds{ std::chrono::duration<float>(written - start).count() };
+	std::cout << "Rendered " << numFrames << " frames in " << renderSeconds << "s (" << numFrames / renderSeconds << " fps), "
+		<< "written after " << totalSeconds << "s\n";
+	if (numFailed > 0)
+	{
+		std::cout << numFailed << " frames could not be written\n";
+		return 1;
+	}
+	return 0;
+}
+
 void ShutDown(SDL_Window* pWindow)
 {
 	SDL_DestroyWindow(pWindow);
 	SDL_Quit();
 }
 
+//Camera and vehicle only depend on the frame number, so every run renders the same images.
+//Two vehicle turns while the camera dollies in and out and sways a little
+static void ApplyBenchmarkScript(Renderer* pRenderer, uint32_t frame)
+{
+	const float time{ frame / 60.f };
+	const float dolly{ 0.5f - 0.5f * cosf(time * float(M_PI) / 5.f) };
+	const Vector3 origin{ 5.f * sinf(time * float(M_PI) / 3.f), 2.f * dolly, 25.f * dolly };
+	pRenderer->SetCameraPose(origin, 0.05f * sinf(time), 0.1f * sinf(time * float(M_PI) / 3.f));
+	pRenderer->SetRotationAngle(time * float(M_PI) / 4.f);
+}
+
+static int RunBenchmark(const CommandLineOptions& options)
+{
+	if (!CanOpenScene(options.scene))
+		return 1;
+
+	const uint32_t numFrames{ options.numFrames == 0 ? 600 : options.numFrames };
+
+	Benchmark::Stats baseline{};
+	Benchmark::Config baselineConfig{};
+	if (!options.baselinePath.empty() && !Benchmark::ReadStats(options.baselinePath, baseline, baselineConfig))
+	{
+		std::cout << "Could not read the baseline " << options.baselinePath << '\n';
+		return 1;
+	}
+
+	SDL_Init(0);
+	const auto pRenderer = new Renderer(options.width, options.height, options.scene);
+	if (!pRenderer->IsInitialized())
+	{
+		std::cout << "Could not load the scene: " << SDL_GetError() << '\n';
+		delete pRenderer;
+		SDL_Quit();
+		return 1;
+	}
+	pRenderer->SetAVX2KernelsEnabled(options.useAVX2);
+	pRenderer->SetFramePipelineDepth(options.pipelineDepth);
+
+	const Benchmark::Config config{ options.width, options.height, options.warmupFrames, pRenderer->GetNumRasterizerThreads(),
+		pRenderer->GetFramePipelineDepth(), pRenderer->AreAVX2KernelsEnabled() ? "avx2" : "scalar", options.scene.meshPath };
+	if (!options.baselinePath.empty() && !Benchmark::IsSameSetup(config, baselineConfig))
+	{
+		std::cout << "The baseline was recorded with a different setup, its numbers can't be compared\n";
+		delete pRenderer;
+		SDL_Quit();
+		return 1;
+	}
+
+	//The counters of a frame are only known once it is presented, which is a few Render calls later because of the
+	//frame pipelining. Counting presented frames keeps them on the frames that were timed
+	Benchmark benchmark{};
+	uint32_t numPresented{};
+	pRenderer->SetPresentCallback([&](const uint32_t*)
+		{
+			if (numPresented++ >= options.warmupFrames)
+				benchmark.AddFrameStats(pRenderer->GetFrameStats());
+		});
+
+	for (uint32_t frame{}; frame < options.warmupFrames; ++frame)
+	{
+		ApplyBenchmarkScript(pRenderer, frame);
+		pRenderer->Render();
+	}
+
+	//Frame time = time between two Render calls returning, like the interactive loop would see it
+	auto previous{ std::chrono::steady_clock::now() };
+	for (uint32_t frame{}; frame < numFrames; ++frame)
+	{
+		ApplyBenchmarkScript(pRenderer, options.warmupFrames + frame);
+		pRenderer->Render();
+
+		const auto now{ std::chrono::steady_clock::now() };
+		benchmark.AddFrameTime(std::chrono::duration<float, std::milli>(now - previous).count());
+		previous = now;
+	}
+	//Presents the last measured frames, so their counters get added too
+	pRenderer->FlushSoftwareFrames();
+	if (!options.tracePath.empty())
+		Profiler::WriteChromeTrace(options.tracePath);
+
+	delete pRenderer;
+	SDL_Quit();
+
+	const Benchmark::Stats stats{ benchmark.CalculateStats() };
+	std::cout << "Frames: " << stats.numFrames << "  mean: " << stats.meanMs << "ms  p50: " << stats.p50Ms << "ms  p95: " << stats.p95Ms
+		<< "ms  p99: " << stats.p99Ms << "ms  1% low: " << stats.low1PercentFps << " fps\n";
+
+	if (!benchmark.WriteJson(options.benchmarkPath, config))
+	{
+		std::cout << "Could not write " << options.benchmarkPath << '\n';
+		return 1;
+	}
+
+	if (!options.baselinePath.empty() && Benchmark::IsRegression(stats, baseline, options.tolerance))
+		return 1;
+
+	return 0;
+}
+
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	PROFILE_THREAD_NAME("Main thread");
+
+	if (argc > 1)
+	{
+		CommandLineOptions options{};
+		if (!ParseCommandLineOptions(argc, args, options))
+			return 1;
+
+		if (!options.benchmarkPath.empty())
+			return RunBenchmark(options);
+
+		return RunBatch(options);
+	}
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
@@ -93,6 +484,9 @@ int main(int argc, char* args[])
 				case SDL_SCANCODE_F11:
 					pRenderer->SwitchFPSPrinting(g_PrintPFS);
 					break;
+				case SDL_SCANCODE_F12:
+					pRenderer->SwitchVisibilityBufferShading();
+					break;
 				}
 				break;
 			default: 